@@ -1,4 +1,7 @@
 #include "ContinuousControlPawn.h"
+#include "DroneEnvSubsystem.h"
+#include "DroneReward.hpp"
+#include "Misc/CommandLine.h"
 #include <cmath>
 
 DEFINE_LOG_CATEGORY(LogUnrealEditorDroneController);
@@ -22,6 +25,33 @@ void AContinuousControlPawn::init(UStaticMeshComponent* mesh) {
 
 	this->orig_root_pos = { root_pos.X, root_pos.Y, root_pos.Z };
 	this->orig_root_rot = { root_rot.X, root_rot.Y, root_rot.Z, root_rot.W };
+
+	// The environment index is part of the randomization seed, so register before the first spec is sampled.
+	UDroneEnvSubsystem* env_subsystem = this->GetWorld()->GetSubsystem<UDroneEnvSubsystem>();
+	if (env_subsystem && this->env_idx < 0) {
+		this->env_idx = env_subsystem->addEnv(this);
+	}
+
+	DroneAerodynamics& aerodynamics = this->nominal_drone_spec.aerodynamics;
+	aerodynamics.enable_body_drag = this->enable_body_drag;
+	aerodynamics.linear_drag_coefs = { this->linear_drag_coefs.X, this->linear_drag_coefs.Y, this->linear_drag_coefs.Z };
+	aerodynamics.quadratic_drag_coefs = { this->quadratic_drag_coefs.X, this->quadratic_drag_coefs.Y, this->quadratic_drag_coefs.Z };
+	aerodynamics.enable_rotor_drag = this->enable_rotor_drag;
+	aerodynamics.rotor_drag_coef = this->rotor_drag_coef;
+	aerodynamics.enable_ground_effect = this->enable_ground_effect;
+	aerodynamics.ground_height = this->ground_height;
+	aerodynamics.set_rotor_radius(this->rotor_radius);
+	this->multirotor_physics.set_drone_spec(this->nominal_drone_spec);
+
+	this->drone_spec_randomization.drone_mass = this->mass_randomization;
+	this->drone_spec_randomization.inertia = this->inertia_randomization;
+	this->drone_spec_randomization.rpm_to_thrust_coefs = this->thrust_coef_randomization;
+	this->drone_spec_randomization.rpm_to_torque_coef = this->torque_coef_randomization;
+	this->drone_spec_randomization.rotor_positions = this->rotor_position_randomization;
+	this->drone_spec_randomization.motor_asymmetry = this->motor_asymmetry_randomization;
+	this->seedRandomization();
+	this->resampleDroneSpec();
+
 	this->multirotor_physics.init({
 			this->orig_root_pos, /* position */
 			this->orig_root_rot, /* orientation */
@@ -32,6 +62,28 @@ void AContinuousControlPawn::init(UStaticMeshComponent* mesh) {
 	this->is_initialized = true;
 }
 
+void AContinuousControlPawn::seedRandomization() {
+	if (this->randomization_seed == 0) {
+		std::random_device random_device;
+		this->randomization_rng.seed(random_device());
+		return;
+	}
+	// Workers launched by a DroneEnvBroker serve the same level, so their environment indices coincide.
+	int32 worker_idx = 0;
+	FParse::Value(FCommandLine::Get(), TEXT("DroneBrokerWorker="), worker_idx);
+	std::seed_seq seed_sequence = { static_cast<uint32>(this->randomization_seed), static_cast<uint32>(worker_idx), static_cast<uint32>(this->env_idx) };
+	this->randomization_rng.seed(seed_sequence);
+}
+
+void AContinuousControlPawn::resampleDroneSpec() {
+	if (!this->drone_spec_randomization.is_enabled()) {
+		return;
+	}
+	DroneSpec spec;
+	randomize_drone_spec(this->nominal_drone_spec, this->drone_spec_randomization, this->randomization_rng, spec);
+	this->multirotor_physics.set_drone_spec(spec);
+}
+
 // Called when the game starts or when spawned
 void AContinuousControlPawn::BeginPlay() {
 	Super::BeginPlay();
@@ -55,9 +107,38 @@ void AContinuousControlPawn::Tick(float DeltaTime) {
 	if (this->action_input.empty()) {
 		return;
 	}
+	// Without auto_reset, the finished episode was already recorded and the drone waits where it ended until it is Reset.
+	if (this->needs_reset) {
+		return;
+	}
 
 	// TODO avoid action copy
-	this->multirotor_physics.apply_control({ { this->action_input[0], this->action_input[1], this->action_input[2], this->action_input[3] } }, DeltaTime);
+	const DroneControlAction action = { { this->action_input[0], this->action_input[1], this->action_input[2], this->action_input[3] } };
+	const double dt = this->getPhysicsDt(DeltaTime);
+	const int32 num_steps = this->getActionRepeat();
+
+	float reward = 0.f;
+	for (int32 step = 0; step < num_steps; step++) {
+		this->multirotor_physics.apply_control(action, dt);
+		this->updateMeshTransform();
+		reward += this->computeStepReward();
+		if (this->needs_reset) {
+			break;
+		}
+	}
+	this->transition_reward = reward;
+
+	this->updateEpisode();
+
+	const linalg::vec3& new_pos = this->multirotor_physics.get_position();
+	const linalg::quat& new_rot = this->multirotor_physics.get_orientation();
+	UE_LOG(LogUnrealEditorDroneController, Display, TEXT("Tick update: position=%s, rotation=%s"),
+		*(FVector(new_pos.x, new_pos.y, new_pos.z).ToString()), *(FQuat(new_rot.x, new_rot.y, new_rot.z, new_rot.w).ToString()));
+
+	Super::Tick(DeltaTime);
+}
+
+void AContinuousControlPawn::updateMeshTransform() {
 
 	const linalg::vec3& new_pos = this->multirotor_physics.get_position();
 	const linalg::quat& new_rot = this->multirotor_physics.get_orientation();
@@ -65,15 +146,52 @@ void AContinuousControlPawn::Tick(float DeltaTime) {
 	const FVector ue_pos = { new_pos.x, new_pos.y, new_pos.z };
 	const FQuat ue_rot = { new_rot.x, new_rot.y, new_rot.z, new_rot.w };
 
-	UE_LOG(LogUnrealEditorDroneController, Display, TEXT("Tick update: position=%s, rotation=%s"), *(ue_pos.ToString()), *(ue_rot.ToString()));
-
 	FHitResult collisions;
 	this->mesh_component->SetWorldLocationAndRotation(ue_pos, ue_rot, false, &collisions, ETeleportType::TeleportPhysics);
 	if (collisions.bBlockingHit) {
 		this->needs_reset = true;
 	}
+}
 
-	Super::Tick(DeltaTime);
+void AContinuousControlPawn::updateEpisode() {
+
+	UDroneEnvSubsystem* env_subsystem = this->GetWorld()->GetSubsystem<UDroneEnvSubsystem>();
+	if (env_subsystem == nullptr || this->env_idx < 0) {
+		return;
+	}
+	const bool episode_ended = env_subsystem->getEpisodeStats().record_transition(this->env_idx, this->transition_reward, this->needs_reset, this->max_episode_steps);
+	if (!episode_ended) {
+		return;
+	}
+
+	this->terminal_state = this->multirotor_physics.get_current_drone_state();
+	if (this->auto_reset) {
+		this->resetEpisode();
+	} else {
+		// Truncated episodes have to be reset by the trainer as well.
+		this->needs_reset = true;
+	}
+}
+
+void AContinuousControlPawn::resetEpisode() {
+
+	this->needs_reset = false;
+	this->num_episode_resets++;
+	this->resampleDroneSpec();
+	this->multirotor_physics.init({
+		this->orig_root_pos, /* position */
+		this->orig_root_rot, /* orientation */
+		{ 0.0, 0.0, 0.0 }, /* linear_velocity */
+		{ 0.0, 0.0, 0.0 } /* angular_velocity */
+	});
+
+	const linalg::vec3& new_pos = this->multirotor_physics.get_position();
+	const linalg::quat& new_rot = this->multirotor_physics.get_orientation();
+
+	const FVector ue_pos = { new_pos.x, new_pos.y, new_pos.z };
+	const FQuat ue_rot = { new_rot.x, new_rot.y, new_rot.z, new_rot.w };
+
+	this->mesh_component->SetWorldLocationAndRotation(ue_pos, ue_rot, false, nullptr, ETeleportType::TeleportPhysics);
 }
 
 // Called to bind functionality to input
@@ -86,71 +204,26 @@ inline bool AContinuousControlPawn::needsReset() const {
 	return needs_reset;
 }
 
-inline float AContinuousControlPawn::computeReward() const {
+inline float AContinuousControlPawn::computeStepReward() const {
 
 	if (!is_initialized) {
 		return 0.f;
 	}
 
-	//if (this->needs_reset) {
-	//	return 0.0;
-	//}
-	double rew = 0.0;
-
-	//const DroneState& prev_state = this->multirotor_physics.get_prev_drone_state();
 	const DroneState& current_state = this->multirotor_physics.get_current_drone_state();
-
-	rew -= 5.0 * (1 - current_state.orientation.w * current_state.orientation.w);
-	
-	rew -= 5.0 * (std::abs(this->orig_root_pos.x - current_state.position.x)
-			+ std::abs(this->orig_root_pos.y - current_state.position.y)
-			+ std::abs(this->orig_root_pos.z - current_state.position.z));
-
-	rew -= 0.01 * (std::abs(current_state.linear_velocity.x)
-					+ std::abs(current_state.linear_velocity.y)
-					+ std::abs(current_state.linear_velocity.z));
-
-	//rew -= 0.0 * std::abs(current_state.angular_velocity.x)
-	//							 + std::abs(current_state.angular_velocity.y)
-	//							 + std::abs(current_state.angular_velocity.z);
-
-	//linalg::vec3 linear_acc;
-	//linalg::sub(current_state.linear_velocity, prev_state.linear_velocity, linear_acc);
-	//const double dt_sq = this->multirotor_physics.get_prev_to_curr_dt() * this->multirotor_physics.get_prev_to_curr_dt();
-	//rew -= (std::abs(linear_acc.x) + std::abs(linear_acc.y) + std::abs(linear_acc.z)) / dt_sq;
-	
-	//linalg::vec3 angular_acc;
-	//linalg::sub(current_state.angular_velocity, prev_state.angular_velocity, angular_acc);
-	//rew -= (std::abs(angular_acc.x) + std::abs(angular_acc.y) + std::abs(angular_acc.z)) / dt_sq;
-
-	double control_bias_cost = 0.0;
-	const DroneControlAction& prev_action = this->multirotor_physics.get_prev_action();
-	for (int i = 0; i < this->action_space_dim; i++) {
-		double diff = (prev_action.rmps_per_rotor[i] - DroneControlAction::STABLE_HOVER_BIAS) * DroneControlAction::ONE_OVER_RANGE;
-		control_bias_cost += diff * diff;
-	}
-
-	rew -= 0.01 * control_bias_cost;
-	return 0.5 * rew + 2.0;
+	return hover_reward(current_state, this->multirotor_physics.get_prev_action(), this->orig_root_pos);
 }
 
 void AContinuousControlPawn::Reset() {
 	Super::Reset();
+	this->needs_reset = false;
+	this->transition_reward = 0.f;
 	if (this->is_initialized) {
-		this->multirotor_physics.init({
-			this->orig_root_pos, /* position */
-			this->orig_root_rot, /* orientation */
-			{ 0.0, 0.0, 0.0 }, /* linear_velocity */
-			{ 0.0, 0.0, 0.0 } /* angular_velocity */
-		});
-
-		const linalg::vec3& new_pos = this->multirotor_physics.get_position();
-		const linalg::quat& new_rot = this->multirotor_physics.get_orientation();
-
-		const FVector ue_pos = { new_pos.x, new_pos.y, new_pos.z };
-		const FQuat ue_rot = { new_rot.x, new_rot.y, new_rot.z, new_rot.w };
-
-		this->mesh_component->SetWorldLocationAndRotation(ue_pos, ue_rot, false, nullptr, ETeleportType::TeleportPhysics);
+		UDroneEnvSubsystem* env_subsystem = this->GetWorld()->GetSubsystem<UDroneEnvSubsystem>();
+		if (env_subsystem && this->env_idx >= 0) {
+			env_subsystem->getEpisodeStats().restart_episode(this->env_idx);
+		}
+		this->resetEpisode();
 	}
 }
 
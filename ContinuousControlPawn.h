@@ -4,6 +4,8 @@
 #include "GameFramework/Pawn.h"
 #include <vector>
 #include "MultirotorPhysics.hpp"
+#include "DroneSpecRandomization.hpp"
+#include <random>
 
 #include "ContinuousControlPawn.generated.h"
 
@@ -26,20 +28,151 @@ public:
 
 	inline bool needsReset() const;
 
-	inline float computeReward() const;
+	/**
+	* Reward of the last transition, i.e. summed over the action_repeat physics steps of the last tick.
+	*/
+	inline float computeReward() const {
+		return this->is_initialized ? this->transition_reward : 0.f;
+	}
 	
 	inline const DroneState& getDroneState() const {
 		return this->multirotor_physics.get_current_drone_state();
 	}
 
+	inline const MultirotorPhysics& getMultirotorPhysics() const {
+		return this->multirotor_physics;
+	}
+
+	inline const linalg::vec3& getTargetPosition() const {
+		return this->orig_root_pos;
+	}
+
+	inline bool isInitialized() const {
+		return this->is_initialized;
+	}
+
+	/**
+	* Duration of one physics step in a tick of DeltaTime.
+	*/
+	inline double getPhysicsDt(const float DeltaTime) const {
+		return this->physics_dt > 0.f ? this->physics_dt : DeltaTime;
+	}
+
+	/**
+	* Number of physics steps every action is applied for, so the control period is getActionRepeat() * getPhysicsDt(DeltaTime).
+	*/
+	inline int32 getActionRepeat() const {
+		return FMath::Max(1, this->action_repeat);
+	}
+
+	/**
+	* Number of times the drone was put back to its initial state, by a Reset or by auto_reset.
+	*/
+	inline uint32 getNumEpisodeResets() const {
+		return this->num_episode_resets;
+	}
+
+	inline int32 getEnvIndex() const {
+		return this->env_idx;
+	}
+
+	/**
+	* State in which the last finished episode ended. With auto_reset, the pawn is already reset to the
+	* initial state of the next episode when the trainer observes the transition, so this is kept separately.
+	*/
+	inline const DroneState& getTerminalDroneState() const {
+		return this->terminal_state;
+	}
+
 	int action_space_dim = -1;
 	std::vector<double> action_input;
 	uint32 observation_space_dim = 0;
 
+	// Number of physics steps every action is applied for within one tick. The steps are reported as one transition,
+	// their rewards are summed and the remaining steps are skipped once the drone needs a reset.
+	UPROPERTY(EditAnywhere, Category = "Simulation")
+	int32 action_repeat = 1;
+
+	// Duration of one physics step. If <= 0, every physics step advances by the tick's DeltaTime.
+	UPROPERTY(EditAnywhere, Category = "Simulation")
+	float physics_dt = 0.f;
+
+	// Reset finished episodes within the same tick instead of waiting for the trainer to trigger a Reset.
+	// The end of the episode is then reported through the episode bookkeeping of UDroneEnvSubsystem.
+	UPROPERTY(EditAnywhere, Category = "Simulation")
+	bool auto_reset = false;
+
+	// Episodes are truncated after this many transitions. 0 means no time limit.
+	UPROPERTY(EditAnywhere, Category = "Simulation")
+	int32 max_episode_steps = 0;
+
+	// Relative half widths of the uniform distributions the physical parameters are resampled from on every Reset, see DroneSpecRandomization.
+	UPROPERTY(EditAnywhere, Category = "Domain Randomization")
+	float mass_randomization = 0.f;
+
+	UPROPERTY(EditAnywhere, Category = "Domain Randomization")
+	float inertia_randomization = 0.f;
+
+	UPROPERTY(EditAnywhere, Category = "Domain Randomization")
+	float thrust_coef_randomization = 0.f;
+
+	UPROPERTY(EditAnywhere, Category = "Domain Randomization")
+	float torque_coef_randomization = 0.f;
+
+	UPROPERTY(EditAnywhere, Category = "Domain Randomization")
+	float rotor_position_randomization = 0.f;
+
+	UPROPERTY(EditAnywhere, Category = "Domain Randomization")
+	float motor_asymmetry_randomization = 0.f;
+
+	// Optional aerodynamic effects, see DroneAerodynamics. Lengths are in cm like the pawn's position, drag coefficients
+	// apply to the body frame velocity in cm/s.
+	UPROPERTY(EditAnywhere, Category = "Aerodynamics")
+	bool enable_body_drag = false;
+
+	UPROPERTY(EditAnywhere, Category = "Aerodynamics")
+	FVector linear_drag_coefs = FVector::ZeroVector;
+
+	UPROPERTY(EditAnywhere, Category = "Aerodynamics")
+	FVector quadratic_drag_coefs = FVector::ZeroVector;
+
+	UPROPERTY(EditAnywhere, Category = "Aerodynamics")
+	bool enable_rotor_drag = false;
+
+	UPROPERTY(EditAnywhere, Category = "Aerodynamics")
+	float rotor_drag_coef = 0.f;
+
+	UPROPERTY(EditAnywhere, Category = "Aerodynamics")
+	bool enable_ground_effect = false;
+
+	// World Z of the floor the ground effect is computed against.
+	UPROPERTY(EditAnywhere, Category = "Aerodynamics")
+	float ground_height = 0.f;
+
+	UPROPERTY(EditAnywhere, Category = "Aerodynamics", meta = (ClampMin = 0.01))
+	float rotor_radius = 2.31f;
+
+	// Combined with the environment index and the broker worker index, so that every environment samples
+	// its own reproducible sequence of specs. 0 seeds every environment nondeterministically.
+	UPROPERTY(EditAnywhere, Category = "Domain Randomization")
+	int32 randomization_seed = 0;
+
 protected:
 
 	void init(UStaticMeshComponent* skeletal_mesh);
 
+	void seedRandomization();
+
+	void resampleDroneSpec();
+
+	void updateMeshTransform();
+
+	void updateEpisode();
+
+	void resetEpisode();
+
+	inline float computeStepReward() const;
+
 	virtual void Reset() override;
 
 	// Called when the game starts or when spawned
@@ -55,6 +188,15 @@ private:
 	UStaticMeshComponent* mesh_component = nullptr;
 	linalg::vec3 orig_root_pos;
 	linalg::quat orig_root_rot;
+
+	DroneSpec nominal_drone_spec;
+	DroneSpecRandomization drone_spec_randomization;
+	std::mt19937 randomization_rng;
 	
 	std::atomic<bool> needs_reset = false;
+	float transition_reward = 0.f;
+
+	int32 env_idx = -1;
+	DroneState terminal_state;
+	uint32 num_episode_resets = 0;
 };
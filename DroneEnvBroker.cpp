@@ -0,0 +1,248 @@
+#include "DroneEnvBroker.hpp"
+#include "MultirotorPhysics.hpp"
+
+static constexpr double PROCESS_CHECK_INTERVAL_SECONDS = 0.1;
+static constexpr double SHUTDOWN_GRACE_SECONDS = 5.0;
+
+DroneEnvBroker::DroneEnvBroker(const DroneEnvBrokerConfig& InConfig) : config(InConfig) {
+	if (this->config.worker_executable.IsEmpty()) {
+		this->config.worker_executable = FPlatformProcess::ExecutablePath();
+	}
+}
+
+DroneEnvBroker::~DroneEnvBroker() {
+	this->stop();
+}
+
+bool DroneEnvBroker::start() {
+
+	for (int32 worker_idx = 0; worker_idx < this->config.num_workers; worker_idx++) {
+		this->workers.push_back(std::make_unique<Worker>());
+		if (!this->launch_worker(worker_idx)) {
+			UE_LOG(LogDroneEnvBroker, Error, TEXT("Failed to launch worker %d."), worker_idx);
+			return false;
+		}
+	}
+
+	uint32 num_envs = 0;
+	for (int32 worker_idx = 0; worker_idx < this->config.num_workers; worker_idx++) {
+		if (!this->wait_until_ready(worker_idx)) {
+			UE_LOG(LogDroneEnvBroker, Error, TEXT("Worker %d didn't become ready."), worker_idx);
+			return false;
+		}
+		Worker& worker = *this->workers[worker_idx];
+		worker.num_envs = worker.batch.get_header()->num_envs;
+		worker.env_offset = num_envs;
+		num_envs += worker.num_envs;
+	}
+
+	if (!this->trainer_batch.create(this->config.name, num_envs, DroneState::DIM, DroneControlAction::DIM)) {
+		UE_LOG(LogDroneEnvBroker, Error, TEXT("Failed to create shared memory %s."), *this->config.name);
+		return false;
+	}
+	for (int32 worker_idx = 0; worker_idx < this->config.num_workers; worker_idx++) {
+		this->gather(worker_idx);
+	}
+	DroneSharedBatchHeader* header = this->trainer_batch.get_header();
+	header->num_envs = num_envs;
+	header->ready.store(1, std::memory_order_release);
+
+	UE_LOG(LogDroneEnvBroker, Display, TEXT("Serving %u drones from %d workers on shared memory %s."), num_envs, this->config.num_workers, *this->config.name);
+	return true;
+}
+
+bool DroneEnvBroker::run() {
+
+	DroneSharedBatchHeader* header = this->trainer_batch.get_header();
+	double last_check = FPlatformTime::Seconds();
+	double idle_start = last_check;
+	while (!header->shutdown.load(std::memory_order_acquire)) {
+		if (header->request_seq.load(std::memory_order_acquire) > this->handled_seq) {
+			if (!this->step()) {
+				return false;
+			}
+			idle_start = FPlatformTime::Seconds();
+			continue;
+		}
+		const double now = FPlatformTime::Seconds();
+		if (now - last_check > PROCESS_CHECK_INTERVAL_SECONDS) {
+			last_check = now;
+			if (!this->supervise()) {
+				return false;
+			}
+		}
+		DroneSharedBatch::backoff(now - idle_start);
+	}
+	this->stop();
+	return true;
+}
+
+void DroneEnvBroker::stop() {
+	for (int32 worker_idx = 0; worker_idx < static_cast<int32>(this->workers.size()); worker_idx++) {
+		this->terminate_worker(worker_idx);
+		this->workers[worker_idx]->batch.release();
+	}
+	this->workers.clear();
+	this->trainer_batch.release();
+}
+
+bool DroneEnvBroker::step() {
+
+	this->handled_seq++;
+
+	const float* actions = this->trainer_batch.get_actions();
+	for (std::unique_ptr<Worker>& worker : this->workers) {
+		FMemory::Memcpy(worker->batch.get_actions(), actions + worker->env_offset * DroneControlAction::DIM, worker->num_envs * DroneControlAction::DIM * sizeof(float));
+		worker->batch.get_header()->request_seq.store(++worker->seq, std::memory_order_release);
+	}
+
+	for (int32 worker_idx = 0; worker_idx < this->config.num_workers; worker_idx++) {
+		if (!this->wait_for_response(worker_idx) && !this->restart_worker(worker_idx)) {
+			return false;
+		}
+		// A restarted worker hasn't stepped yet, so this continues from its initial observations.
+		this->gather(worker_idx);
+		if (this->workers[worker_idx]->pending_truncation) {
+			this->report_truncation(worker_idx);
+		}
+	}
+
+	this->trainer_batch.get_header()->response_seq.store(this->handled_seq, std::memory_order_release);
+	return true;
+}
+
+void DroneEnvBroker::gather(const int32 worker_idx) {
+	const Worker& worker = *this->workers[worker_idx];
+	const uint32 offset = worker.env_offset;
+	const uint32 num_envs = worker.num_envs;
+
+	FMemory::Memcpy(this->trainer_batch.get_observations() + offset * DroneState::DIM, worker.batch.get_observations(), num_envs * DroneState::DIM * sizeof(float));
+	FMemory::Memcpy(this->trainer_batch.get_terminal_observations() + offset * DroneState::DIM, worker.batch.get_terminal_observations(), num_envs * DroneState::DIM * sizeof(float));
+	FMemory::Memcpy(this->trainer_batch.get_rewards() + offset, worker.batch.get_rewards(), num_envs * sizeof(float));
+	FMemory::Memcpy(this->trainer_batch.get_terminated() + offset, worker.batch.get_terminated(), num_envs * sizeof(uint8));
+	FMemory::Memcpy(this->trainer_batch.get_truncated() + offset, worker.batch.get_truncated(), num_envs * sizeof(uint8));
+}
+
+void DroneEnvBroker::report_truncation(const int32 worker_idx) {
+	Worker& worker = *this->workers[worker_idx];
+	const uint32 offset = worker.env_offset;
+	const uint32 num_envs = worker.num_envs;
+
+	FMemory::Memcpy(this->trainer_batch.get_terminal_observations() + offset * DroneState::DIM, worker.lost_observations.data(), num_envs * DroneState::DIM * sizeof(float));
+	FMemory::Memzero(this->trainer_batch.get_rewards() + offset, num_envs * sizeof(float));
+	FMemory::Memzero(this->trainer_batch.get_terminated() + offset, num_envs * sizeof(uint8));
+	FMemory::Memset(this->trainer_batch.get_truncated() + offset, 1, num_envs * sizeof(uint8));
+	worker.pending_truncation = false;
+}
+
+bool DroneEnvBroker::supervise() {
+	for (int32 worker_idx = 0; worker_idx < this->config.num_workers; worker_idx++) {
+		if (!FPlatformProcess::IsProcRunning(this->workers[worker_idx]->process) && !this->restart_worker(worker_idx)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool DroneEnvBroker::launch_worker(const int32 worker_idx) {
+	Worker& worker = *this->workers[worker_idx];
+	const FString shm_name = FString::Printf(TEXT("%s_worker%d"), *this->config.name, worker_idx);
+
+	// A restarted worker reuses the region of its predecessor.
+	if (worker.batch.is_mapped()) {
+		worker.batch.reset();
+	} else if (!worker.batch.create(shm_name, this->config.max_envs_per_worker, DroneState::DIM, DroneControlAction::DIM)) {
+		return false;
+	}
+	worker.seq = 0;
+
+	const FString params = FString::Printf(TEXT("%s -game -nullrhi -nosound -unattended -benchmark -fps=%d -DroneBrokerShm=%s -DroneBrokerPid=%u -DroneBrokerWorker=%d"),
+		*this->config.worker_params, this->config.worker_fps, *shm_name, FPlatformProcess::GetCurrentProcessId(), worker_idx);
+	worker.process = FPlatformProcess::CreateProc(*this->config.worker_executable, *params, false, true, true, nullptr, 0, nullptr, nullptr);
+	return worker.process.IsValid();
+}
+
+bool DroneEnvBroker::wait_until_ready(const int32 worker_idx) {
+	Worker& worker = *this->workers[worker_idx];
+	const double start_time = FPlatformTime::Seconds();
+	while (!worker.batch.get_header()->ready.load(std::memory_order_acquire)) {
+		if (!FPlatformProcess::IsProcRunning(worker.process) || FPlatformTime::Seconds() - start_time > this->config.startup_timeout_seconds) {
+			return false;
+		}
+		FPlatformProcess::Sleep(0.01f);
+	}
+	return true;
+}
+
+bool DroneEnvBroker::wait_for_response(const int32 worker_idx) {
+	Worker& worker = *this->workers[worker_idx];
+	const DroneSharedBatchHeader* header = worker.batch.get_header();
+	const double start_time = FPlatformTime::Seconds();
+	double last_check = start_time;
+	while (header->response_seq.load(std::memory_order_acquire) < worker.seq) {
+		const double now = FPlatformTime::Seconds();
+		if (now - last_check > PROCESS_CHECK_INTERVAL_SECONDS) {
+			last_check = now;
+			if (!FPlatformProcess::IsProcRunning(worker.process)) {
+				return false;
+			}
+		}
+		if (now - start_time > this->config.step_timeout_seconds) {
+			return false;
+		}
+		DroneSharedBatch::backoff(now - start_time);
+	}
+	return true;
+}
+
+bool DroneEnvBroker::restart_worker(const int32 worker_idx) {
+	Worker& worker = *this->workers[worker_idx];
+	if (worker.num_restarts >= this->config.max_worker_restarts) {
+		UE_LOG(LogDroneEnvBroker, Error, TEXT("Worker %d crashed or hung after %d restarts, giving up."), worker_idx, worker.num_restarts);
+		return false;
+	}
+	UE_LOG(LogDroneEnvBroker, Warning, TEXT("Worker %d crashed or hung, restarting it."), worker_idx);
+	this->terminate_worker(worker_idx);
+
+	// The trainer still holds the last observations of the lost episodes.
+	if (!worker.pending_truncation) {
+		const float* observations = this->trainer_batch.get_observations() + worker.env_offset * DroneState::DIM;
+		worker.lost_observations.assign(observations, observations + worker.num_envs * DroneState::DIM);
+		worker.pending_truncation = true;
+	}
+
+	for (int32 attempt = 0; attempt < this->config.max_restart_attempts; attempt++) {
+		if (!this->launch_worker(worker_idx) || !this->wait_until_ready(worker_idx)) {
+			this->terminate_worker(worker_idx);
+			continue;
+		}
+		if (worker.batch.get_header()->num_envs != worker.num_envs) {
+			UE_LOG(LogDroneEnvBroker, Error, TEXT("Restarted worker %d serves %u drones instead of %u."), worker_idx, worker.batch.get_header()->num_envs.load(), worker.num_envs);
+			return false;
+		}
+		worker.num_restarts++;
+		return true;
+	}
+
+	UE_LOG(LogDroneEnvBroker, Error, TEXT("Failed to restart worker %d."), worker_idx);
+	return false;
+}
+
+void DroneEnvBroker::terminate_worker(const int32 worker_idx) {
+	Worker& worker = *this->workers[worker_idx];
+	if (!worker.process.IsValid()) {
+		return;
+	}
+	if (worker.batch.is_mapped()) {
+		worker.batch.get_header()->shutdown.store(1, std::memory_order_release);
+	}
+	const double start_time = FPlatformTime::Seconds();
+	while (FPlatformProcess::IsProcRunning(worker.process) && FPlatformTime::Seconds() - start_time < SHUTDOWN_GRACE_SECONDS) {
+		FPlatformProcess::Sleep(0.01f);
+	}
+	if (FPlatformProcess::IsProcRunning(worker.process)) {
+		FPlatformProcess::TerminateProc(worker.process, true);
+	}
+	FPlatformProcess::CloseProc(worker.process);
+	worker.process.Reset();
+}
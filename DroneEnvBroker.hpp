@@ -0,0 +1,94 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DroneSharedBatch.hpp"
+#include <memory>
+#include <vector>
+
+struct DroneEnvBrokerConfig {
+	// Name of the shared memory region the trainer attaches to. Workers use <name>_worker<idx>.
+	FString name = TEXT("DroneEnvBroker");
+	int32 num_workers = 4;
+	uint32 max_envs_per_worker = 64;
+	// Defaults to the executable of the broker process.
+	FString worker_executable;
+	// Passed to every worker in front of the broker switches, e.g. the project file and the map.
+	FString worker_params;
+	double startup_timeout_seconds = 120.0;
+	// A worker that doesn't answer a step within this time is considered hung and restarted.
+	double step_timeout_seconds = 10.0;
+	// Launch attempts per restart of a worker.
+	int32 max_restart_attempts = 3;
+	// Restarts of the same worker over the lifetime of the broker, after which the broker gives up.
+	int32 max_worker_restarts = 10;
+	// Fixed frame rate of the workers (-benchmark -fps=). Their frames wait for the trainer, so without a fixed
+	// time step the simulated time of a step would depend on the latency of the trainer.
+	int32 worker_fps = 100;
+};
+
+/**
+ * Launches and supervises headless simulator instances, shards their environments into one batch and serves
+ * that batch to the trainer through a DroneSharedBatch named config.name. Crashed or hung workers are restarted
+ * transparently: their environments report a truncated episode with the last observation as terminal observation.
+ */
+class RL_DRONE_ENV_API DroneEnvBroker {
+public:
+	explicit DroneEnvBroker(const DroneEnvBrokerConfig& InConfig);
+	~DroneEnvBroker();
+
+	/**
+	* Launches all workers and waits until they and their environments are ready. Returns false on failure.
+	*/
+	bool start();
+
+	/**
+	* Serves step requests of the trainer until it sets the shutdown flag. Returns false if a worker couldn't be restarted.
+	*/
+	bool run();
+
+	void stop();
+
+private:
+	struct Worker {
+		DroneSharedBatch batch;
+		FProcHandle process;
+		uint64 seq = 0;
+		uint32 env_offset = 0;
+		uint32 num_envs = 0;
+		int32 num_restarts = 0;
+		// Set by a restart until the lost episodes were reported to the trainer as truncated.
+		bool pending_truncation = false;
+		std::vector<float> lost_observations;
+	};
+
+	bool launch_worker(const int32 worker_idx);
+	bool wait_until_ready(const int32 worker_idx);
+	bool wait_for_response(const int32 worker_idx);
+	bool restart_worker(const int32 worker_idx);
+	void terminate_worker(const int32 worker_idx);
+
+	/**
+	* Scatters the actions of the trainer to the workers, gathers their results and publishes them to the trainer.
+	*/
+	bool step();
+
+	/**
+	* Copies the results of a worker into its slice of the trainer batch.
+	*/
+	void gather(const int32 worker_idx);
+
+	/**
+	* Reports the episodes lost by a restart as truncated in the last observations the trainer has seen.
+	*/
+	void report_truncation(const int32 worker_idx);
+
+	/**
+	* Checks the worker processes between steps and restarts the ones that died.
+	*/
+	bool supervise();
+
+	DroneEnvBrokerConfig config;
+	std::vector<std::unique_ptr<Worker>> workers;
+	DroneSharedBatch trainer_batch;
+	uint64 handled_seq = 0;
+};
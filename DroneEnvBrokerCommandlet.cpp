@@ -0,0 +1,35 @@
+#include "DroneEnvBrokerCommandlet.h"
+#include "DroneEnvBroker.hpp"
+#include "Misc/Paths.h"
+
+UDroneEnvBrokerCommandlet::UDroneEnvBrokerCommandlet() {
+	IsClient = false;
+	IsServer = false;
+	IsEditor = false;
+	LogToConsole = true;
+}
+
+int32 UDroneEnvBrokerCommandlet::Main(const FString& Params) {
+
+	DroneEnvBrokerConfig config;
+	FParse::Value(*Params, TEXT("Name="), config.name);
+	FParse::Value(*Params, TEXT("Workers="), config.num_workers);
+	FParse::Value(*Params, TEXT("MaxEnvsPerWorker="), config.max_envs_per_worker);
+	FParse::Value(*Params, TEXT("WorkerExecutable="), config.worker_executable);
+	FParse::Value(*Params, TEXT("WorkerParams="), config.worker_params, false);
+	FParse::Value(*Params, TEXT("StepTimeout="), config.step_timeout_seconds);
+	FParse::Value(*Params, TEXT("StartupTimeout="), config.startup_timeout_seconds);
+	FParse::Value(*Params, TEXT("MaxRestartAttempts="), config.max_restart_attempts);
+	FParse::Value(*Params, TEXT("MaxWorkerRestarts="), config.max_worker_restarts);
+	FParse::Value(*Params, TEXT("WorkerFps="), config.worker_fps);
+	if (config.worker_params.IsEmpty()) {
+		config.worker_params = FString::Printf(TEXT("\"%s\""), *FPaths::ConvertRelativePathToFull(FPaths::GetProjectFilePath()));
+	}
+
+	DroneEnvBroker broker(config);
+	if (!broker.start()) {
+		broker.stop();
+		return 1;
+	}
+	return broker.run() ? 0 : 1;
+}
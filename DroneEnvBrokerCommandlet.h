@@ -0,0 +1,22 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "DroneEnvBrokerCommandlet.generated.h"
+
+/**
+ * Runs a DroneEnvBroker as its own process, e.g.
+ *   UnrealEditor-Cmd <project> -run=DroneEnvBroker -Workers=8 -Name=DroneEnvBroker -WorkerParams="<project> <map>"
+ * Optional switches: -MaxEnvsPerWorker=, -WorkerExecutable=, -StepTimeout=, -StartupTimeout=, -MaxRestartAttempts=,
+ * -MaxWorkerRestarts=, -WorkerFps=.
+ */
+UCLASS()
+class RL_DRONE_ENV_API UDroneEnvBrokerCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UDroneEnvBrokerCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
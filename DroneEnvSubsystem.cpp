@@ -0,0 +1,13 @@
+#include "DroneEnvSubsystem.h"
+#include "ContinuousControlPawn.h"
+
+int32 UDroneEnvSubsystem::addEnv(AContinuousControlPawn* pawn) {
+	const int32 env_idx = this->episode_stats.add_env();
+	this->pawns.Add(pawn);
+	check(this->pawns.Num() == this->episode_stats.num_envs());
+	return env_idx;
+}
+
+AContinuousControlPawn* UDroneEnvSubsystem::getPawn(const int32 env_idx) const {
+	return this->pawns[env_idx].Get();
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "DroneEpisodeStats.hpp"
+#include "DroneEnvSubsystem.generated.h"
+
+class AContinuousControlPawn;
+
+/**
+ * Owns the state that is shared by all drone environments of a world.
+ */
+UCLASS()
+class RL_DRONE_ENV_API UDroneEnvSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+
+	/**
+	* Registers the environment simulated by pawn and returns its index, which is shared by the episode
+	* bookkeeping and by the batches served to a DroneEnvBroker.
+	*/
+	int32 addEnv(AContinuousControlPawn* pawn);
+
+	inline int32 getNumEnvs() const {
+		return this->pawns.Num();
+	}
+
+	AContinuousControlPawn* getPawn(const int32 env_idx) const;
+
+	inline DroneEpisodeStats& getEpisodeStats() {
+		return this->episode_stats;
+	}
+
+	inline const DroneEpisodeStats& getEpisodeStats() const {
+		return this->episode_stats;
+	}
+
+protected:
+	DroneEpisodeStats episode_stats;
+	TArray<TWeakObjectPtr<AContinuousControlPawn>> pawns;
+};
@@ -0,0 +1,39 @@
+#include "DroneEpisodeStats.hpp"
+
+int32 DroneEpisodeStats::add_env() {
+	this->episode_steps.push_back(0);
+	this->episode_returns.push_back(0.0);
+	this->terminated.push_back(0);
+	this->truncated.push_back(0);
+	this->finished_episode_steps.push_back(0);
+	this->finished_episode_returns.push_back(0.0);
+	this->num_finished_episodes.push_back(0);
+	return this->num_envs() - 1;
+}
+
+void DroneEpisodeStats::restart_episode(const int32 env_idx) {
+	this->episode_steps[env_idx] = 0;
+	this->episode_returns[env_idx] = 0.0;
+	this->terminated[env_idx] = 0;
+	this->truncated[env_idx] = 0;
+}
+
+bool DroneEpisodeStats::record_transition(const int32 env_idx, const float reward, const bool InTerminated, const int32 max_episode_steps) {
+
+	const uint32 steps = ++this->episode_steps[env_idx];
+	this->episode_returns[env_idx] += reward;
+
+	const bool is_truncated = !InTerminated && max_episode_steps > 0 && steps >= static_cast<uint32>(max_episode_steps);
+	this->terminated[env_idx] = InTerminated;
+	this->truncated[env_idx] = is_truncated;
+	if (!InTerminated && !is_truncated) {
+		return false;
+	}
+
+	this->finished_episode_steps[env_idx] = steps;
+	this->finished_episode_returns[env_idx] = this->episode_returns[env_idx];
+	this->num_finished_episodes[env_idx]++;
+	this->episode_steps[env_idx] = 0;
+	this->episode_returns[env_idx] = 0.0;
+	return true;
+}
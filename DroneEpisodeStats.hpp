@@ -0,0 +1,54 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include <vector>
+
+/**
+ * Episode bookkeeping for all environments of a world, stored in compact arrays with one entry per environment,
+ * so that finished environments can be reset in the same step without synchronizing the whole batch.
+ */
+class RL_DRONE_ENV_API DroneEpisodeStats {
+public:
+
+	/**
+	* Registers a new environment and returns its index into the arrays below.
+	*/
+	int32 add_env();
+
+	/**
+	* Starts a new episode without recording the current one as finished, e.g. after an external Reset.
+	*/
+	void restart_episode(const int32 env_idx);
+
+	/**
+	* Records one transition of env_idx and returns true if the episode ended with it, either because
+	* the drone terminated (InTerminated) or because the episode reached max_episode_steps (if > 0) and was truncated.
+	*/
+	bool record_transition(const int32 env_idx, const float reward, const bool InTerminated, const int32 max_episode_steps);
+
+	int32 num_envs() const {
+		return static_cast<int32>(this->episode_steps.size());
+	}
+
+	// Running episodes.
+	const std::vector<uint32>& get_episode_steps() const { return this->episode_steps; }
+	const std::vector<double>& get_episode_returns() const { return this->episode_returns; }
+
+	// Flags of the last recorded transition.
+	const std::vector<uint8>& get_terminated() const { return this->terminated; }
+	const std::vector<uint8>& get_truncated() const { return this->truncated; }
+
+	// Last finished episodes.
+	const std::vector<uint32>& get_finished_episode_steps() const { return this->finished_episode_steps; }
+	const std::vector<double>& get_finished_episode_returns() const { return this->finished_episode_returns; }
+	const std::vector<uint32>& get_num_finished_episodes() const { return this->num_finished_episodes; }
+
+private:
+	std::vector<uint32> episode_steps;
+	std::vector<double> episode_returns;
+	std::vector<uint8> terminated;
+	std::vector<uint8> truncated;
+	std::vector<uint32> finished_episode_steps;
+	std::vector<double> finished_episode_returns;
+	std::vector<uint32> num_finished_episodes;
+};
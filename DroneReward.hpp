@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cmath>
+#include "MultirotorPhysics.hpp"
+
+/**
+ * Reward for hovering at target_position after action led to state.
+ * Shared by the RL environment and the planners that roll out MultirotorPhysics, so that both optimize the same objective.
+ */
+static inline double hover_reward(const DroneState& state, const DroneControlAction& action, const linalg::vec3& target_position) {
+
+	double rew = 0.0;
+
+	rew -= 5.0 * (1 - state.orientation.w * state.orientation.w);
+	
+	rew -= 5.0 * (std::abs(target_position.x - state.position.x)
+			+ std::abs(target_position.y - state.position.y)
+			+ std::abs(target_position.z - state.position.z));
+
+	rew -= 0.01 * (std::abs(state.linear_velocity.x)
+					+ std::abs(state.linear_velocity.y)
+					+ std::abs(state.linear_velocity.z));
+
+	//rew -= 0.0 * std::abs(state.angular_velocity.x)
+	//							 + std::abs(state.angular_velocity.y)
+	//							 + std::abs(state.angular_velocity.z);
+
+	double control_bias_cost = 0.0;
+	for (int i = 0; i < DroneControlAction::DIM; i++) {
+		double diff = (action.rmps_per_rotor[i] - DroneControlAction::STABLE_HOVER_BIAS) * DroneControlAction::ONE_OVER_RANGE;
+		control_bias_cost += diff * diff;
+	}
+
+	rew -= 0.01 * control_bias_cost;
+	return 0.5 * rew + 2.0;
+}
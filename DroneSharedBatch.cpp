@@ -0,0 +1,109 @@
+#include "DroneSharedBatch.hpp"
+#include <new>
+
+DEFINE_LOG_CATEGORY(LogDroneEnvBroker);
+
+static constexpr uint32 SHARED_MEMORY_READ_WRITE = static_cast<uint32>(FPlatformMemory::ESharedMemoryAccess::Read) | static_cast<uint32>(FPlatformMemory::ESharedMemoryAccess::Write);
+
+static inline SIZE_T align_up(const SIZE_T size) {
+	return (size + DroneSharedBatchHeader::ALIGNMENT - 1) / DroneSharedBatchHeader::ALIGNMENT * DroneSharedBatchHeader::ALIGNMENT;
+}
+
+DroneSharedBatch::~DroneSharedBatch() {
+	this->release();
+}
+
+SIZE_T DroneSharedBatch::required_size(const uint32 capacity, const uint32 observation_dim, const uint32 action_dim) {
+	return align_up(sizeof(DroneSharedBatchHeader))
+		+ align_up(sizeof(float) * capacity * action_dim)
+		+ 2 * align_up(sizeof(float) * capacity * observation_dim)
+		+ align_up(sizeof(float) * capacity)
+		+ 2 * align_up(sizeof(uint8) * capacity);
+}
+
+bool DroneSharedBatch::create(const FString& name, const uint32 capacity, const uint32 observation_dim, const uint32 action_dim) {
+
+	this->release();
+	const SIZE_T size = required_size(capacity, observation_dim, action_dim);
+	this->region = FPlatformMemory::MapNamedSharedMemoryRegion(name, true, SHARED_MEMORY_READ_WRITE, size);
+	if (this->region == nullptr) {
+		return false;
+	}
+	FMemory::Memzero(this->region->GetAddress(), size);
+
+	this->header = new (this->region->GetAddress()) DroneSharedBatchHeader();
+	this->header->capacity = capacity;
+	this->header->observation_dim = observation_dim;
+	this->header->action_dim = action_dim;
+	this->reset();
+	this->header->version = DroneSharedBatchHeader::VERSION;
+	this->header->magic = DroneSharedBatchHeader::MAGIC;
+
+	this->bind_arrays();
+	return true;
+}
+
+void DroneSharedBatch::reset() {
+	this->header->num_envs = 0;
+	this->header->ready = 0;
+	this->header->shutdown = 0;
+	this->header->request_seq = 0;
+	this->header->response_seq = 0;
+}
+
+bool DroneSharedBatch::attach(const FString& name) {
+
+	this->release();
+
+	// Map the header first to learn the size of the whole region.
+	FPlatformMemory::FSharedMemoryRegion* header_region = FPlatformMemory::MapNamedSharedMemoryRegion(name, false, SHARED_MEMORY_READ_WRITE, sizeof(DroneSharedBatchHeader));
+	if (header_region == nullptr) {
+		return false;
+	}
+	const DroneSharedBatchHeader* mapped_header = static_cast<const DroneSharedBatchHeader*>(header_region->GetAddress());
+	const bool is_valid = mapped_header->magic == DroneSharedBatchHeader::MAGIC && mapped_header->version == DroneSharedBatchHeader::VERSION;
+	const SIZE_T size = required_size(mapped_header->capacity, mapped_header->observation_dim, mapped_header->action_dim);
+	FPlatformMemory::UnmapNamedSharedMemoryRegion(header_region);
+	if (!is_valid) {
+		return false;
+	}
+
+	this->region = FPlatformMemory::MapNamedSharedMemoryRegion(name, false, SHARED_MEMORY_READ_WRITE, size);
+	if (this->region == nullptr) {
+		return false;
+	}
+	this->header = static_cast<DroneSharedBatchHeader*>(this->region->GetAddress());
+	this->bind_arrays();
+	return true;
+}
+
+void DroneSharedBatch::release() {
+	if (this->region) {
+		FPlatformMemory::UnmapNamedSharedMemoryRegion(this->region);
+	}
+	this->region = nullptr;
+	this->header = nullptr;
+	this->actions = nullptr;
+	this->observations = nullptr;
+	this->terminal_observations = nullptr;
+	this->rewards = nullptr;
+	this->terminated = nullptr;
+	this->truncated = nullptr;
+}
+
+void DroneSharedBatch::bind_arrays() {
+	const SIZE_T capacity = this->header->capacity;
+	uint8* address = reinterpret_cast<uint8*>(this->header) + align_up(sizeof(DroneSharedBatchHeader));
+
+	this->actions = reinterpret_cast<float*>(address);
+	address += align_up(sizeof(float) * capacity * this->header->action_dim);
+	this->observations = reinterpret_cast<float*>(address);
+	address += align_up(sizeof(float) * capacity * this->header->observation_dim);
+	this->terminal_observations = reinterpret_cast<float*>(address);
+	address += align_up(sizeof(float) * capacity * this->header->observation_dim);
+	this->rewards = reinterpret_cast<float*>(address);
+	address += align_up(sizeof(float) * capacity);
+	this->terminated = address;
+	address += align_up(sizeof(uint8) * capacity);
+	this->truncated = address;
+}
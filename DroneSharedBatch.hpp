@@ -0,0 +1,112 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/PlatformMemory.h"
+#include "HAL/PlatformProcess.h"
+#include <atomic>
+
+DECLARE_LOG_CATEGORY_EXTERN(LogDroneEnvBroker, Log, All);
+
+/**
+ * Header of a batch of environments in named shared memory. The same layout is used between the trainer and
+ * DroneEnvBroker and between the broker and each of its workers:
+ *
+ *   header | actions [capacity][action_dim] float | observations [capacity][observation_dim] float
+ *          | terminal_observations [capacity][observation_dim] float | rewards [capacity] float
+ *          | terminated [capacity] uint8 | truncated [capacity] uint8
+ *
+ * Every array starts at a multiple of ALIGNMENT. To step, the client writes the actions of all num_envs
+ * environments, increments request_seq and waits until response_seq equals it. Environments reset
+ * themselves when they are done; the observation they ended in is in terminal_observations.
+ */
+struct DroneSharedBatchHeader {
+	static constexpr uint32 MAGIC = 0x424E5244; // "DRNB"
+	static constexpr uint32 VERSION = 1;
+	static constexpr SIZE_T ALIGNMENT = 64;
+
+	uint32 magic;
+	uint32 version;
+	uint32 capacity;
+	uint32 observation_dim;
+	uint32 action_dim;
+	// Number of environments actually hosted, valid once ready is set.
+	std::atomic<uint32> num_envs;
+	// Set by the server side once num_envs and the initial observations are valid.
+	std::atomic<uint32> ready;
+	// Set by the client side to shut the server side down.
+	std::atomic<uint32> shutdown;
+	std::atomic<uint64> request_seq;
+	std::atomic<uint64> response_seq;
+};
+
+static_assert(std::atomic<uint64>::is_always_lock_free, "Shared memory synchronization needs lock free 64 bit atomics.");
+
+/**
+ * A DroneSharedBatchHeader and its arrays mapped into this process.
+ */
+class RL_DRONE_ENV_API DroneSharedBatch {
+public:
+	DroneSharedBatch() = default;
+	DroneSharedBatch(const DroneSharedBatch&) = delete;
+	DroneSharedBatch& operator=(const DroneSharedBatch&) = delete;
+	~DroneSharedBatch();
+
+	static SIZE_T required_size(const uint32 capacity, const uint32 observation_dim, const uint32 action_dim);
+
+	// Waits shorter than this are spun, longer ones sleep for IDLE_SLEEP_SECONDS per poll.
+	static constexpr double SPIN_SECONDS = 0.002;
+	static constexpr float IDLE_SLEEP_SECONDS = 0.0005f;
+
+	/**
+	* One poll of a loop that waits for the other side of a batch, which has been waiting for waited_seconds.
+	* Short waits only yield, so that a quick answer is picked up right away, long ones sleep to free the core.
+	*/
+	static inline void backoff(const double waited_seconds) {
+		if (waited_seconds < SPIN_SECONDS) {
+			FPlatformProcess::YieldThread();
+		} else {
+			FPlatformProcess::Sleep(IDLE_SLEEP_SECONDS);
+		}
+	}
+
+	/**
+	* Creates (or recreates) the named region and initializes the header. Returns false if the region can't be mapped.
+	*/
+	bool create(const FString& name, const uint32 capacity, const uint32 observation_dim, const uint32 action_dim);
+
+	/**
+	* Reinitializes the header of a created region for a new server process, keeping the mapping.
+	*/
+	void reset();
+
+	/**
+	* Maps a region that was created by another process. Returns false if it doesn't exist or has an unexpected layout.
+	*/
+	bool attach(const FString& name);
+
+	void release();
+
+	bool is_mapped() const {
+		return this->header != nullptr;
+	}
+
+	DroneSharedBatchHeader* get_header() const { return this->header; }
+	float* get_actions() const { return this->actions; }
+	float* get_observations() const { return this->observations; }
+	float* get_terminal_observations() const { return this->terminal_observations; }
+	float* get_rewards() const { return this->rewards; }
+	uint8* get_terminated() const { return this->terminated; }
+	uint8* get_truncated() const { return this->truncated; }
+
+private:
+	void bind_arrays();
+
+	FPlatformMemory::FSharedMemoryRegion* region = nullptr;
+	DroneSharedBatchHeader* header = nullptr;
+	float* actions = nullptr;
+	float* observations = nullptr;
+	float* terminal_observations = nullptr;
+	float* rewards = nullptr;
+	uint8* terminated = nullptr;
+	uint8* truncated = nullptr;
+};
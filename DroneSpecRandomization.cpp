@@ -0,0 +1,29 @@
+#include "DroneSpecRandomization.hpp"
+
+static inline double sample_scale(const double relative_range, std::mt19937& rng) {
+	if (relative_range <= 0.0) {
+		return 1.0;
+	}
+	std::uniform_real_distribution<double> distribution(1.0 - relative_range, 1.0 + relative_range);
+	return distribution(rng);
+}
+
+void randomize_drone_spec(const DroneSpec& nominal, const DroneSpecRandomization& randomization, std::mt19937& rng, DroneSpec& out) {
+
+	out = nominal;
+
+	out.drone_mass *= sample_scale(randomization.drone_mass, rng);
+
+	out.J.v_0_0 *= sample_scale(randomization.inertia, rng);
+	out.J.v_1_1 *= sample_scale(randomization.inertia, rng);
+	out.J.v_2_2 *= sample_scale(randomization.inertia, rng);
+	linalg::inverse(out.J, out.J_inv);
+
+	linalg::scalar_multiply(out.rpm_to_thrust_coefs, sample_scale(randomization.rpm_to_thrust_coefs, rng));
+	out.rpm_to_torque_coef *= sample_scale(randomization.rpm_to_torque_coef, rng);
+
+	for (size_t rotor_idx = 0; rotor_idx < out.num_rotors; rotor_idx++) {
+		linalg::scalar_multiply(out.rotor_positions[rotor_idx], sample_scale(randomization.rotor_positions, rng));
+		out.motor_thrust_scales[rotor_idx] *= sample_scale(randomization.motor_asymmetry, rng);
+	}
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MultirotorPhysics.hpp"
+#include <random>
+
+/**
+ * Distributions of the physical parameters for domain randomization. Every entry is the relative
+ * half width of a uniform distribution around the nominal value, e.g. 0.1 samples within +-10%.
+ * 0 keeps the nominal value.
+ */
+struct DroneSpecRandomization {
+	double drone_mass = 0.0;
+	// Applied to each principal moment of inertia independently.
+	double inertia = 0.0;
+	double rpm_to_thrust_coefs = 0.0;
+	double rpm_to_torque_coef = 0.0;
+	// Applied to the arm length of each rotor independently.
+	double rotor_positions = 0.0;
+	// Applied to the thrust of each motor independently.
+	double motor_asymmetry = 0.0;
+
+	bool is_enabled() const {
+		return drone_mass > 0.0 || inertia > 0.0 || rpm_to_thrust_coefs > 0.0 || rpm_to_torque_coef > 0.0
+			|| rotor_positions > 0.0 || motor_asymmetry > 0.0;
+	}
+};
+
+/**
+ * Sample a spec around nominal. Derived quantities (J_inv) are recomputed, so out can directly be
+ * used with MultirotorPhysics::set_drone_spec or stored in a batch of per-environment specs.
+ */
+RL_DRONE_ENV_API void randomize_drone_spec(const DroneSpec& nominal, const DroneSpecRandomization& randomization, std::mt19937& rng, DroneSpec& out);
@@ -0,0 +1,195 @@
+#include "DroneWorkerSubsystem.h"
+#include "DroneEnvSubsystem.h"
+#include "ContinuousControlPawn.h"
+#include "EngineUtils.h"
+#include "Misc/App.h"
+#include "Misc/CommandLine.h"
+
+// How often the worker checks whether the broker is still alive while it waits for a request.
+static constexpr double BROKER_CHECK_INTERVAL_SECONDS = 1.0;
+
+static inline bool getBrokerShmName(FString& name) {
+	return FParse::Value(FCommandLine::Get(), TEXT("DroneBrokerShm="), name);
+}
+
+static inline void writeDroneState(const DroneState& drone_state, float* out) {
+	out[0] = drone_state.position.x;
+	out[1] = drone_state.position.y;
+	out[2] = drone_state.position.z;
+
+	out[3] = drone_state.orientation.x;
+	out[4] = drone_state.orientation.y;
+	out[5] = drone_state.orientation.z;
+	out[6] = drone_state.orientation.w;
+
+	out[7] = drone_state.linear_velocity.x;
+	out[8] = drone_state.linear_velocity.y;
+	out[9] = drone_state.linear_velocity.z;
+
+	out[10] = drone_state.angular_velocity.x;
+	out[11] = drone_state.angular_velocity.y;
+	out[12] = drone_state.angular_velocity.z;
+}
+
+bool UDroneWorkerSubsystem::ShouldCreateSubsystem(UObject* Outer) const {
+	FString name;
+	return getBrokerShmName(name) && Super::ShouldCreateSubsystem(Outer);
+}
+
+bool UDroneWorkerSubsystem::DoesSupportWorldType(const EWorldType::Type WorldType) const {
+	return WorldType == EWorldType::Game;
+}
+
+void UDroneWorkerSubsystem::Initialize(FSubsystemCollectionBase& Collection) {
+	Super::Initialize(Collection);
+	Collection.InitializeDependency(UDroneEnvSubsystem::StaticClass());
+
+	FString name;
+	getBrokerShmName(name);
+	if (!this->batch.attach(name)) {
+		UE_LOG(LogDroneEnvBroker, Error, TEXT("Worker can't attach to shared memory %s."), *name);
+		FPlatformMisc::RequestExit(false);
+		return;
+	}
+	if (this->batch.get_header()->observation_dim != DroneState::DIM || this->batch.get_header()->action_dim != DroneControlAction::DIM) {
+		UE_LOG(LogDroneEnvBroker, Error, TEXT("Shared memory %s has an unexpected layout."), *name);
+		this->batch.release();
+		FPlatformMisc::RequestExit(false);
+		return;
+	}
+	FParse::Value(FCommandLine::Get(), TEXT("DroneBrokerPid="), this->broker_pid);
+
+	this->tick_start_handle = FWorldDelegates::OnWorldTickStart.AddUObject(this, &UDroneWorkerSubsystem::onWorldTickStart);
+	this->post_actor_tick_handle = FWorldDelegates::OnWorldPostActorTick.AddUObject(this, &UDroneWorkerSubsystem::onWorldPostActorTick);
+}
+
+void UDroneWorkerSubsystem::Deinitialize() {
+	FWorldDelegates::OnWorldTickStart.Remove(this->tick_start_handle);
+	FWorldDelegates::OnWorldPostActorTick.Remove(this->post_actor_tick_handle);
+	this->batch.release();
+	Super::Deinitialize();
+}
+
+void UDroneWorkerSubsystem::onWorldTickStart(UWorld* World, ELevelTick TickType, float DeltaSeconds) {
+	if (World != this->GetWorld() || !this->batch.is_mapped()) {
+		return;
+	}
+	DroneSharedBatchHeader* header = this->batch.get_header();
+	if (!header->ready.load(std::memory_order_acquire)) {
+		return;
+	}
+
+	// Block the frame until the broker requests the next step.
+	const double wait_start = FPlatformTime::Seconds();
+	double last_broker_check = wait_start;
+	while (header->request_seq.load(std::memory_order_acquire) <= this->handled_seq) {
+		if (header->shutdown.load(std::memory_order_acquire)) {
+			FPlatformMisc::RequestExit(false);
+			return;
+		}
+		const double now = FPlatformTime::Seconds();
+		if (now - last_broker_check > BROKER_CHECK_INTERVAL_SECONDS) {
+			last_broker_check = now;
+			if (this->broker_pid != 0 && !FPlatformProcess::IsApplicationRunning(this->broker_pid)) {
+				UE_LOG(LogDroneEnvBroker, Error, TEXT("Broker process %u is gone, shutting down."), this->broker_pid);
+				FPlatformMisc::RequestExit(false);
+				return;
+			}
+		}
+		DroneSharedBatch::backoff(now - wait_start);
+	}
+	this->handled_seq++;
+
+	const UDroneEnvSubsystem* env_subsystem = World->GetSubsystem<UDroneEnvSubsystem>();
+	const uint32 num_envs = header->num_envs;
+	const float* actions = this->batch.get_actions();
+	for (uint32 env_idx = 0; env_idx < num_envs; env_idx++) {
+		AContinuousControlPawn* pawn = env_subsystem->getPawn(env_idx);
+		if (pawn) {
+			const float* env_actions = actions + env_idx * DroneControlAction::DIM;
+			pawn->action_input.assign(env_actions, env_actions + DroneControlAction::DIM);
+		}
+	}
+	this->is_stepping = true;
+}
+
+void UDroneWorkerSubsystem::onWorldPostActorTick(UWorld* World, ELevelTick TickType, float DeltaSeconds) {
+	if (World != this->GetWorld() || !this->batch.is_mapped()) {
+		return;
+	}
+	DroneSharedBatchHeader* header = this->batch.get_header();
+	if (!header->ready.load(std::memory_order_acquire)) {
+		this->tryBecomeReady();
+		return;
+	}
+	if (!this->is_stepping) {
+		return;
+	}
+
+	this->writeObservations();
+	header->response_seq.store(this->handled_seq, std::memory_order_release);
+	this->is_stepping = false;
+}
+
+void UDroneWorkerSubsystem::tryBecomeReady() {
+	UWorld* world = this->GetWorld();
+	UDroneEnvSubsystem* env_subsystem = world->GetSubsystem<UDroneEnvSubsystem>();
+
+	// Pawns register themselves on their first tick, so wait until all of them did.
+	int32 num_pawns = 0;
+	for (TActorIterator<AContinuousControlPawn> it(world); it; ++it) {
+		num_pawns++;
+	}
+	const int32 num_envs = env_subsystem->getNumEnvs();
+	if (num_pawns == 0 || num_envs < num_pawns) {
+		return;
+	}
+
+	DroneSharedBatchHeader* header = this->batch.get_header();
+	if (static_cast<uint32>(num_envs) > header->capacity) {
+		UE_LOG(LogDroneEnvBroker, Error, TEXT("Level has %d drones, but the broker only has room for %u per worker."), num_envs, header->capacity);
+		FPlatformMisc::RequestExit(false);
+		return;
+	}
+
+	// The frames block until the broker requests a step, so DeltaTime includes the latency of the trainer.
+	// Pawns that step by DeltaTime are switched to the fixed frame time the broker launches the worker with.
+	if (!FApp::UseFixedTimeStep()) {
+		UE_LOG(LogDroneEnvBroker, Warning, TEXT("Worker doesn't run with a fixed time step (-benchmark -fps=), using %f s per physics step."), FApp::GetFixedDeltaTime());
+	}
+	for (int32 env_idx = 0; env_idx < num_envs; env_idx++) {
+		AContinuousControlPawn* pawn = env_subsystem->getPawn(env_idx);
+		if (pawn) {
+			pawn->auto_reset = true;
+			if (pawn->physics_dt <= 0.f) {
+				pawn->physics_dt = FApp::GetFixedDeltaTime();
+			}
+		}
+	}
+	header->num_envs = num_envs;
+	this->writeObservations();
+	FMemory::Memzero(this->batch.get_rewards(), num_envs * sizeof(float));
+	FMemory::Memzero(this->batch.get_terminated(), num_envs * sizeof(uint8));
+	FMemory::Memzero(this->batch.get_truncated(), num_envs * sizeof(uint8));
+	header->ready.store(1, std::memory_order_release);
+
+	UE_LOG(LogDroneEnvBroker, Display, TEXT("Worker serving %d drones."), num_envs);
+}
+
+void UDroneWorkerSubsystem::writeObservations() {
+	const UDroneEnvSubsystem* env_subsystem = this->GetWorld()->GetSubsystem<UDroneEnvSubsystem>();
+	const DroneEpisodeStats& episode_stats = env_subsystem->getEpisodeStats();
+	const uint32 num_envs = this->batch.get_header()->num_envs;
+
+	for (uint32 env_idx = 0; env_idx < num_envs; env_idx++) {
+		const AContinuousControlPawn* pawn = env_subsystem->getPawn(env_idx);
+		if (pawn == nullptr) {
+			continue;
+		}
+		writeDroneState(pawn->getDroneState(), this->batch.get_observations() + env_idx * DroneState::DIM);
+		writeDroneState(pawn->getTerminalDroneState(), this->batch.get_terminal_observations() + env_idx * DroneState::DIM);
+		this->batch.get_rewards()[env_idx] = pawn->computeReward();
+		this->batch.get_terminated()[env_idx] = episode_stats.get_terminated()[env_idx];
+		this->batch.get_truncated()[env_idx] = episode_stats.get_truncated()[env_idx];
+	}
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "DroneSharedBatch.hpp"
+#include "DroneWorkerSubsystem.generated.h"
+
+/**
+ * Serves the drone environments of a game instance that was launched by DroneEnvBroker (-DroneBrokerShm=<name>).
+ * Every frame blocks until the broker requests a step, applies the requested actions to the pawns and publishes
+ * the resulting observations, rewards and episode flags at the end of the frame. Pawns are switched to auto_reset,
+ * so the broker never has to wait for a reset, and to a fixed physics_dt, so a step doesn't depend on the trainer's latency.
+ */
+UCLASS()
+class RL_DRONE_ENV_API UDroneWorkerSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+
+protected:
+	virtual bool DoesSupportWorldType(const EWorldType::Type WorldType) const override;
+
+private:
+	void onWorldTickStart(UWorld* World, ELevelTick TickType, float DeltaSeconds);
+	void onWorldPostActorTick(UWorld* World, ELevelTick TickType, float DeltaSeconds);
+
+	/**
+	* Publishes the environments to the broker once all pawns of the level are initialized.
+	*/
+	void tryBecomeReady();
+
+	void writeObservations();
+
+	DroneSharedBatch batch;
+	uint64 handled_seq = 0;
+	bool is_stepping = false;
+	uint32 broker_pid = 0;
+
+	FDelegateHandle tick_start_handle;
+	FDelegateHandle post_actor_tick_handle;
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+/**
+ * Piecewise linear interpolation of a function sampled on a uniform grid over [x_min, x_max].
+ * Used to replace expensive terms in the hot path by a clamp, one multiply-add and two loads.
+ * Arguments outside of the range are clamped to the boundary values (with zero derivative).
+ */
+template<int N>
+class InterpolatedTable {
+public:
+    static_assert(N >= 2, "InterpolatedTable needs at least two samples.");
+
+    template<typename Function>
+    InterpolatedTable(const double InXMin, const double InXMax, Function function)
+        : x_min(InXMin), x_max(InXMax), one_over_step((N - 1) / (InXMax - InXMin)) {
+        for (int i = 0; i < N; i++) {
+            this->values[i] = function(InXMin + i * (InXMax - InXMin) / (N - 1));
+        }
+        for (int i = 0; i < N - 1; i++) {
+            this->deltas[i] = this->values[i + 1] - this->values[i];
+        }
+    }
+
+    inline double evaluate(const double x, double& derivative) const {
+        if (x <= this->x_min) {
+            derivative = 0.0;
+            return this->values[0];
+        }
+        if (x >= this->x_max) {
+            derivative = 0.0;
+            return this->values[N - 1];
+        }
+        const double position = (x - this->x_min) * this->one_over_step;
+        const int idx = position < N - 1 ? static_cast<int>(position) : N - 2;
+        derivative = this->deltas[idx] * this->one_over_step;
+        return this->values[idx] + (position - idx) * this->deltas[idx];
+    }
+
+    inline double evaluate(const double x) const {
+        double derivative;
+        return this->evaluate(x, derivative);
+    }
+
+private:
+    double x_min;
+    double x_max;
+    double one_over_step;
+    double values[N];
+    double deltas[N - 1];
+};
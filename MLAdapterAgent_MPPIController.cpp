@@ -0,0 +1,30 @@
+#include "MLAdapterAgent_MPPIController.h"
+#include "ContinuousControlPawn.h"
+
+
+void UMLAdapterAgent_MPPIController::Act(const float DeltaTime) {
+	AContinuousControlPawn* pawn = Cast<AContinuousControlPawn>(GetAvatar());
+	if (pawn == nullptr || !pawn->isInitialized()) {
+		return;
+	}
+	if (!this->planner) {
+		MPPIConfig config;
+		config.num_rollouts = this->num_rollouts;
+		config.horizon = this->horizon;
+		config.temperature = this->temperature;
+		config.noise_std = this->noise_std_rpm;
+		config.max_iterations = this->max_iterations;
+		config.time_budget_seconds = this->time_budget_seconds;
+		this->planner = std::make_unique<MultirotorMPPI>(config);
+		this->planned_episode_resets = pawn->getNumEpisodeResets();
+	}
+	// The drone was put back to its initial state, so the remainder of the previous plan doesn't apply anymore.
+	if (pawn->getNumEpisodeResets() != this->planned_episode_resets) {
+		this->planned_episode_resets = pawn->getNumEpisodeResets();
+		this->planner->reset();
+	}
+
+	const DroneControlAction action = this->planner->plan(pawn->getMultirotorPhysics(), pawn->getDroneState(), pawn->getTargetPosition(),
+		pawn->getPhysicsDt(DeltaTime), pawn->getActionRepeat());
+	pawn->action_input.assign(std::begin(action.rmps_per_rotor), std::end(action.rmps_per_rotor));
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MLAdapterAgent_Controller.h"
+#include "MultirotorMPPI.hpp"
+#include <memory>
+#include "MLAdapterAgent_MPPIController.generated.h"
+
+/**
+ * Drop-in replacement for UMLAdapterAgent_Controller that flies the drone with a sampling-based
+ * model predictive controller instead of the actions sent by the trainer, e.g. to act as a teacher
+ * or as a baseline. Actions sent by the trainer are still consumed, but ignored.
+ */
+UCLASS()
+class RL_DRONE_ENV_API UMLAdapterAgent_MPPIController : public UMLAdapterAgent_Controller
+{
+	GENERATED_BODY()
+
+public:
+
+	virtual void Act(const float DeltaTime) override;
+
+	UPROPERTY(EditAnywhere, Category = "MPPI", meta = (ClampMin = 1))
+	int32 num_rollouts = 2048;
+
+	// Number of planned actions. The rollouts hold every action for one control period of the pawn,
+	// i.e. action_repeat physics steps.
+	UPROPERTY(EditAnywhere, Category = "MPPI", meta = (ClampMin = 1))
+	int32 horizon = 25;
+
+	UPROPERTY(EditAnywhere, Category = "MPPI", meta = (ClampMin = 0.000001))
+	float temperature = 0.1f;
+
+	UPROPERTY(EditAnywhere, Category = "MPPI", meta = (ClampMin = 0))
+	float noise_std_rpm = 0.05f * (DroneControlAction::MAX_RPM - DroneControlAction::MIN_RPM);
+
+	UPROPERTY(EditAnywhere, Category = "MPPI", meta = (ClampMin = 1))
+	int32 max_iterations = 8;
+
+	// Wall clock time the planner may spend per tick.
+	UPROPERTY(EditAnywhere, Category = "MPPI")
+	float time_budget_seconds = 0.004f;
+
+protected:
+	std::unique_ptr<MultirotorMPPI> planner;
+	// getNumEpisodeResets() of the pawn when the planner last planned, to drop the warm start after a reset.
+	uint32 planned_episode_resets = 0;
+};
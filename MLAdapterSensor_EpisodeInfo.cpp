@@ -0,0 +1,63 @@
+#include "MLAdapterSensor_EpisodeInfo.h"
+#include "DroneEnvSubsystem.h"
+
+UMLAdapterSensor_EpisodeInfo::UMLAdapterSensor_EpisodeInfo(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer) {
+	TickPolicy = EMLAdapterTickPolicy::EveryTick;
+}
+
+void UMLAdapterSensor_EpisodeInfo::SenseImpl(const float DeltaTime) {
+	if (this->pawn == nullptr || this->pawn->getEnvIndex() < 0) {
+		return;
+	}
+	const UDroneEnvSubsystem* env_subsystem = this->pawn->GetWorld()->GetSubsystem<UDroneEnvSubsystem>();
+	if (env_subsystem == nullptr) {
+		return;
+	}
+	const DroneEpisodeStats& episode_stats = env_subsystem->getEpisodeStats();
+	const int32 env_idx = this->pawn->getEnvIndex();
+
+	this->episode_info_features[0] = episode_stats.get_terminated()[env_idx];
+	this->episode_info_features[1] = episode_stats.get_truncated()[env_idx];
+	this->episode_info_features[2] = episode_stats.get_finished_episode_steps()[env_idx];
+	this->episode_info_features[3] = episode_stats.get_finished_episode_returns()[env_idx];
+
+	const DroneState& terminal_state = this->pawn->getTerminalDroneState();
+
+	this->episode_info_features[4] = terminal_state.position.x;
+	this->episode_info_features[5] = terminal_state.position.y;
+	this->episode_info_features[6] = terminal_state.position.z;
+
+	this->episode_info_features[7] = terminal_state.orientation.x;
+	this->episode_info_features[8] = terminal_state.orientation.y;
+	this->episode_info_features[9] = terminal_state.orientation.z;
+	this->episode_info_features[10] = terminal_state.orientation.w;
+
+	this->episode_info_features[11] = terminal_state.linear_velocity.x;
+	this->episode_info_features[12] = terminal_state.linear_velocity.y;
+	this->episode_info_features[13] = terminal_state.linear_velocity.z;
+
+	this->episode_info_features[14] = terminal_state.angular_velocity.x;
+	this->episode_info_features[15] = terminal_state.angular_velocity.y;
+	this->episode_info_features[16] = terminal_state.angular_velocity.z;
+}
+
+void UMLAdapterSensor_EpisodeInfo::OnAvatarSet(AActor* Avatar) {
+	Super::OnAvatarSet(Avatar);
+	this->pawn = Cast<AContinuousControlPawn>(Avatar);
+	if (this->pawn) {
+		this->SenseImpl(0.f);
+		this->UpdateSpaceDef();
+	}
+}
+
+void UMLAdapterSensor_EpisodeInfo::GetObservations(FMLAdapterMemoryWriter& Ar) {
+	FScopeLock Lock(&ObservationCS);
+	FMLAdapter::FSpaceSerializeGuard SerializeGuard(SpaceDef, Ar);
+	// TODO sending double over the wire isn't really supported, unfortunately.
+	Ar.Serialize(this->episode_info_features, DIM * sizeof(double));
+}
+
+TSharedPtr<FMLAdapter::FSpace> UMLAdapterSensor_EpisodeInfo::ConstructSpaceDef() const {
+	return MakeShareable(new FMLAdapter::FSpace_Box({ (uint32)DIM }));
+}
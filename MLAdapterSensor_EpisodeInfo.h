@@ -0,0 +1,34 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Sensors/MLAdapterSensor.h"
+#include "MLAdapterTypes.h"
+#include "ContinuousControlPawn.h"
+#include "MultirotorPhysics.hpp"
+#include "MLAdapterSensor_EpisodeInfo.generated.h"
+
+/**
+ * Observes the episode bookkeeping of the avatar's environment, which the trainer needs when the pawn resets itself (auto_reset):
+ * terminated and truncated flags of the last transition, length and return of the last finished episode and the
+ * terminal observation of that episode, in the same layout as UMLAdapterSensor_DroneState.
+ */
+UCLASS()
+class RL_DRONE_ENV_API UMLAdapterSensor_EpisodeInfo : public UMLAdapterSensor
+{
+	GENERATED_BODY()
+
+public:
+	static constexpr int DIM = 4 + DroneState::DIM;
+
+	UMLAdapterSensor_EpisodeInfo(const FObjectInitializer& ObjectInitializer = FObjectInitializer::Get());
+
+protected:
+	virtual TSharedPtr<FMLAdapter::FSpace> ConstructSpaceDef() const override;
+	virtual void OnAvatarSet(AActor* Avatar) override;
+	virtual void SenseImpl(const float DeltaTime) override;
+	virtual void GetObservations(FMLAdapterMemoryWriter& Ar) override;
+
+	AContinuousControlPawn* pawn = nullptr;
+	double episode_info_features[DIM] = { 0.0 };
+	
+};
@@ -0,0 +1,126 @@
+#include "MultirotorMPPI.hpp"
+#include "DroneReward.hpp"
+#include "Async/ParallelFor.h"
+#include <algorithm>
+#include <cmath>
+
+// Lower bound of the temperature, 1 / temperature has to stay finite.
+static constexpr double MIN_TEMPERATURE = 1e-6;
+
+static MPPIConfig clamp_config(const MPPIConfig& InConfig) {
+	MPPIConfig clamped = InConfig;
+	clamped.num_rollouts = std::max(1, clamped.num_rollouts);
+	clamped.horizon = std::max(1, clamped.horizon);
+	clamped.max_iterations = std::max(1, clamped.max_iterations);
+	clamped.rollouts_per_task = std::max(1, clamped.rollouts_per_task);
+	clamped.temperature = std::max(MIN_TEMPERATURE, clamped.temperature);
+	clamped.noise_std = std::max(0.0, clamped.noise_std);
+	return clamped;
+}
+
+MultirotorMPPI::MultirotorMPPI(const MPPIConfig& InConfig) : config(clamp_config(InConfig)) {
+	this->num_tasks = (this->config.num_rollouts + this->config.rollouts_per_task - 1) / this->config.rollouts_per_task;
+
+	this->nominal_actions.resize(this->config.horizon);
+	this->sampled_actions.resize(static_cast<size_t>(this->config.horizon) * this->config.num_rollouts);
+	this->rollout_states.resize(this->config.num_rollouts);
+	this->rollout_costs.resize(this->config.num_rollouts);
+	for (int task_idx = 0; task_idx < this->num_tasks; task_idx++) {
+		this->task_rngs.emplace_back(this->config.seed + task_idx);
+	}
+	this->reset();
+}
+
+void MultirotorMPPI::reset() {
+	for (DroneControlAction& action : this->nominal_actions) {
+		for (int i = 0; i < DroneControlAction::DIM; i++) {
+			action.rmps_per_rotor[i] = DroneControlAction::MIN_RPM + DroneControlAction::STABLE_HOVER_BIAS;
+		}
+	}
+}
+
+DroneControlAction MultirotorMPPI::plan(const MultirotorPhysics& model, const DroneState& state, const linalg::vec3& target_position,
+	const double dt, const int steps_per_action) {
+
+	const double start_time = FPlatformTime::Seconds();
+	for (int iteration = 0; iteration < this->config.max_iterations; iteration++) {
+		if (iteration > 0 && FPlatformTime::Seconds() - start_time > this->config.time_budget_seconds) {
+			break;
+		}
+		ParallelFor(this->num_tasks, [&](int32 task_idx) {
+			this->rollout_task(task_idx, model, state, target_position, dt, steps_per_action);
+		});
+		this->update_nominal_actions();
+	}
+
+	const DroneControlAction first_action = this->nominal_actions[0];
+
+	// Warm start the next call with the remainder of the sequence.
+	std::copy(this->nominal_actions.begin() + 1, this->nominal_actions.end(), this->nominal_actions.begin());
+
+	return first_action;
+}
+
+void MultirotorMPPI::rollout_task(const int task_idx, const MultirotorPhysics& model, const DroneState& state, const linalg::vec3& target_position,
+	const double dt, const int steps_per_action) {
+
+	const int begin = task_idx * this->config.rollouts_per_task;
+	const int end = std::min(begin + this->config.rollouts_per_task, this->config.num_rollouts);
+	std::mt19937& rng = this->task_rngs[task_idx];
+	// normal_distribution requires a positive standard deviation, without noise every rollout follows the nominal sequence.
+	const bool is_perturbed = this->config.noise_std > 0.0;
+	std::normal_distribution<double> noise(0.0, is_perturbed ? this->config.noise_std : 1.0);
+
+	for (int r = begin; r < end; r++) {
+		this->rollout_states[r] = state;
+		this->rollout_costs[r] = 0.0;
+	}
+
+	for (int t = 0; t < this->config.horizon; t++) {
+		DroneControlAction* actions = &this->sampled_actions[static_cast<size_t>(t) * this->config.num_rollouts];
+		const DroneControlAction& nominal = this->nominal_actions[t];
+
+		for (int r = begin; r < end; r++) {
+			for (int i = 0; i < DroneControlAction::DIM; i++) {
+				// Rollout 0 keeps the unperturbed nominal sequence, so the update never gets worse than the warm start.
+				const double rpm = r == 0 || !is_perturbed ? nominal.rmps_per_rotor[i] : nominal.rmps_per_rotor[i] + noise(rng);
+				actions[r].rmps_per_rotor[i] = std::clamp(rpm, DroneControlAction::MIN_RPM, DroneControlAction::MAX_RPM);
+			}
+		}
+
+		// The cost is accumulated after every physics step, like the reward of the controlled drone.
+		for (int step = 0; step < steps_per_action; step++) {
+			model.predict_batch(&this->rollout_states[begin], &actions[begin], end - begin, dt, &this->rollout_states[begin], nullptr);
+
+			for (int r = begin; r < end; r++) {
+				this->rollout_costs[r] -= hover_reward(this->rollout_states[r], actions[r], target_position);
+			}
+		}
+	}
+}
+
+void MultirotorMPPI::update_nominal_actions() {
+
+	const double min_cost = *std::min_element(this->rollout_costs.begin(), this->rollout_costs.end());
+	const double one_over_temperature = 1.0 / this->config.temperature;
+	double weight_sum = 0.0;
+	for (double& cost : this->rollout_costs) {
+		cost = std::exp(-(cost - min_cost) * one_over_temperature);
+		weight_sum += cost;
+	}
+	const double one_over_weight_sum = 1.0 / weight_sum;
+
+	ParallelFor(this->config.horizon, [&](int32 t) {
+		const DroneControlAction* actions = &this->sampled_actions[static_cast<size_t>(t) * this->config.num_rollouts];
+		double weighted_rpms[DroneControlAction::DIM] = { 0.0 };
+		for (int r = 0; r < this->config.num_rollouts; r++) {
+			const double weight = this->rollout_costs[r];
+			for (int i = 0; i < DroneControlAction::DIM; i++) {
+				weighted_rpms[i] += weight * actions[r].rmps_per_rotor[i];
+			}
+		}
+		for (int i = 0; i < DroneControlAction::DIM; i++) {
+			this->nominal_actions[t].rmps_per_rotor[i] = weighted_rpms[i] * one_over_weight_sum;
+		}
+	});
+}
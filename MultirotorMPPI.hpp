@@ -0,0 +1,69 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MultirotorPhysics.hpp"
+#include <random>
+#include <vector>
+
+struct MPPIConfig {
+	int num_rollouts = 2048;
+	// Number of actions in the planned sequence. Every action is held for one control period, which is passed to plan().
+	int horizon = 25;
+	// Temperature of the softmin over the rollout costs. The lower, the more the best rollouts dominate the update.
+	double temperature = 0.1;
+	// Standard deviation of the rpm perturbations. 0 disables the exploration.
+	double noise_std = 0.05 * (DroneControlAction::MAX_RPM - DroneControlAction::MIN_RPM);
+	int max_iterations = 8;
+	// Wall clock budget for one call of plan(). At least one iteration is always run.
+	double time_budget_seconds = 0.004;
+	// Number of rollouts that are stepped together by one parallel task.
+	int rollouts_per_task = 128;
+	unsigned int seed = 0;
+};
+
+/**
+ * Sampling-based model predictive controller (MPPI) that rolls out thousands of perturbed 
+ * action sequences through MultirotorPhysics and returns the first action of the reweighted nominal sequence.
+ * All buffers are allocated in the constructor, so plan() doesn't allocate.
+ */
+class RL_DRONE_ENV_API MultirotorMPPI {
+public:
+	/**
+	* Sizes that are < 1 in InConfig are raised to 1, the temperature to a small positive value and a negative noise_std to 0.
+	*/
+	explicit MultirotorMPPI(const MPPIConfig& InConfig);
+
+	/**
+	* Forget the warm start, e.g. after the episode was reset.
+	*/
+	void reset();
+
+	/**
+	* Optimize the action sequence starting from state, using model as dynamics and hover_reward
+	* as objective, and return the action to apply now. Like the controlled drone, every action of the sequence
+	* is applied for steps_per_action physics steps of length dt. plan() has to be called once per control period,
+	* i.e. every steps_per_action * dt, so that the warm start stays aligned with the sequence.
+	*/
+	DroneControlAction plan(const MultirotorPhysics& model, const DroneState& state, const linalg::vec3& target_position,
+		const double dt, const int steps_per_action = 1);
+
+	const MPPIConfig& get_config() const {
+		return this->config;
+	}
+
+private:
+
+	void rollout_task(const int task_idx, const MultirotorPhysics& model, const DroneState& state, const linalg::vec3& target_position,
+		const double dt, const int steps_per_action);
+
+	void update_nominal_actions();
+
+	const MPPIConfig config;
+	int num_tasks = 0;
+
+	std::vector<DroneControlAction> nominal_actions; // [horizon]
+	std::vector<DroneControlAction> sampled_actions; // [horizon][num_rollouts], so that each time step is one contiguous batch.
+	std::vector<DroneState> rollout_states; // [num_rollouts]
+	std::vector<double> rollout_costs; // [num_rollouts], turned into the softmin weights by update_nominal_actions.
+	std::vector<std::mt19937> task_rngs; // [num_tasks]
+};
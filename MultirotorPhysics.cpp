@@ -1,7 +1,28 @@
 #include "MultirotorPhysics.hpp"
+#include "InterpolatedTable.hpp"
+#include "Async/ParallelFor.h"
+#include <algorithm>
+#include <cmath>
 
 DEFINE_LOG_CATEGORY(LogUnrealEditorDronePhysics);
 
+// Cheeseman-Bennett ground effect 1 / (1 - (R / 4h)^2) over the height h in rotor radii R. It diverges at h = R / 4,
+// so the table starts at h = R / 2 and is clamped below. It is shifted to be exactly 1 at the end of the table.
+static constexpr double GROUND_EFFECT_MIN_HEIGHT = 0.5;
+static constexpr double GROUND_EFFECT_MAX_HEIGHT = 8.0;
+static inline double cheeseman_bennett(const double height) {
+    const double ratio = 1.0 / (4.0 * height);
+    return 1.0 / (1.0 - ratio * ratio);
+}
+static const InterpolatedTable<64> ground_effect_table(GROUND_EFFECT_MIN_HEIGHT, GROUND_EFFECT_MAX_HEIGHT, [](const double height) {
+    return 1.0 + cheeseman_bennett(height) - cheeseman_bennett(GROUND_EFFECT_MAX_HEIGHT);
+});
+
+// Offsets of the DroneState members in the rows of a TangentBlock.
+static constexpr int ORIENTATION_ROW = 3;
+static constexpr int LINEAR_VELOCITY_ROW = 7;
+static constexpr int ANGULAR_VELOCITY_ROW = 10;
+
 MultirotorPhysics::MultirotorPhysics() {
 }
 
@@ -14,70 +35,546 @@ void MultirotorPhysics::apply_control(const DroneControlAction& action, const do
     this->prev_state = this->current_state;
     this->prev_to_curr_dt = dt;
 
-    DroneState k1 = this->physics_step(this->current_state, action);
+    this->predict(this->prev_state, action, dt, this->current_state);
+}
+
+void MultirotorPhysics::apply_control(const DroneControlAction& action, const double dt, DroneStateJacobians& jacobians) {
+
+    this->prev_action = action;
+    this->prev_state = this->current_state;
+    this->prev_to_curr_dt = dt;
+
+    this->predict(this->prev_state, action, dt, this->current_state, jacobians);
+}
+
+void MultirotorPhysics::predict(const DroneState& state, const DroneControlAction& action, const double dt, DroneState& next_state) const {
+    this->predict(this->drone_spec, state, action, dt, next_state);
+}
+
+void MultirotorPhysics::predict(const DroneState& state, const DroneControlAction& action, const double dt, DroneState& next_state, DroneStateJacobians& jacobians) const {
+    this->predict(this->drone_spec, state, action, dt, next_state, jacobians);
+}
+
+void MultirotorPhysics::predict(const DroneSpec& spec, const DroneState& state, const DroneControlAction& action, const double dt, DroneState& next_state) const {
+
+    RotorWrench wrench;
+    this->rotor_wrench(spec, action, wrench);
+
+    DroneState k1 = this->physics_step(spec, state, wrench);
     DroneState var;
     state_scalar_multiply(k1, dt * 0.5, var);
     {
-        state_add_accumulate(current_state, var);
-        DroneState k2 = this->physics_step(var, action);
+        state_add_accumulate(state, var);
+        DroneState k2 = this->physics_step(spec, var, wrench);
         state_scalar_multiply(k2, dt * 0.5, var);
         state_scalar_multiply_accumulate(k2, 2, k1);
     }
     {
-        state_add_accumulate(current_state, var);
-        DroneState k3 = this->physics_step(var, action);
+        state_add_accumulate(state, var);
+        DroneState k3 = this->physics_step(spec, var, wrench);
         state_scalar_multiply(k3, dt, var);
         state_scalar_multiply_accumulate(k3, 2, k1);
     }
     {
-        state_add_accumulate(current_state, var);
-        DroneState k4 = this->physics_step(var, action);
+        state_add_accumulate(state, var);
+        DroneState k4 = this->physics_step(spec, var, wrench);
         state_add_accumulate(k4, k1);
     }
     state_scalar_multiply(k1, dt / 6.0);
-    state_add_accumulate(current_state, k1);
+    state_add_accumulate(state, k1);
 
     normalize_state(k1);
 
-    this->current_state = k1;
+    next_state = k1;
+}
+
+void MultirotorPhysics::predict(const DroneSpec& spec, const DroneState& state, const DroneControlAction& action, const double dt, DroneState& next_state, DroneStateJacobians& jacobians) const {
+
+    static constexpr int NUM_STAGES = 4;
+    static constexpr double STAGE_WEIGHTS[NUM_STAGES] = { 1.0, 2.0, 2.0, 1.0 };
+    static constexpr double NEXT_STAGE_OFFSETS[NUM_STAGES] = { 0.5, 0.5, 1.0, 0.0 };
+
+    RotorWrench wrench;
+    RotorWrench d_wrenches[DroneControlAction::DIM];
+    this->rotor_wrench(spec, action, wrench, d_wrenches);
+
+    // The tangents of the initial state are the unit vectors of the state directions and zero for the action directions.
+    // d_var: tangents of the current stage input, d_sum: weighted sum of the stage tangents (mirrors sum in the primal rk4 below).
+    TangentBlock d_var;
+    TangentBlock d_sum = {};
+    TangentBlock d_k;
+
+    // Same operations in the same order as the primal predict above, so both produce identical states.
+    DroneState var = state;
+    DroneState sum;
+    PhysicsStepJacobian step_jacobian;
+    for (int stage = 0; stage < NUM_STAGES; stage++) {
+        const DroneState k = this->physics_step(spec, var, wrench, d_wrenches, &step_jacobian);
+
+        if (stage == 0) {
+            physics_step_tangent(step_jacobian, d_k);
+        } else {
+            physics_step_tangent(step_jacobian, d_var, d_k);
+        }
+        const double stage_weight = STAGE_WEIGHTS[stage];
+        const double next_stage_offset = dt * NEXT_STAGE_OFFSETS[stage];
+        for (int i = 0; i < DroneState::DIM; i++) {
+            for (int j = 0; j < TANGENT_BLOCK_WIDTH; j++) {
+                d_sum[i][j] += stage_weight * d_k[i][j];
+                d_var[i][j] = next_stage_offset * d_k[i][j];
+            }
+        }
+        for (int j = 0; j < NUM_STATE_DIRECTIONS; j++) {
+            d_var[FIRST_STATE_DIRECTION + j][j] += 1.0;
+        }
+
+        if (stage == 0) {
+            sum = k;
+        } else {
+            state_scalar_multiply_accumulate(k, STAGE_WEIGHTS[stage], sum);
+        }
+        if (stage + 1 < NUM_STAGES) {
+            state_scalar_multiply(k, next_stage_offset, var);
+            state_add_accumulate(state, var);
+        }
+    }
+    state_scalar_multiply(sum, dt / 6.0);
+    state_add_accumulate(state, sum);
+
+    for (int i = 0; i < DroneState::DIM; i++) {
+        for (int j = 0; j < TANGENT_BLOCK_WIDTH; j++) {
+            d_sum[i][j] *= dt / 6.0;
+        }
+    }
+    for (int j = 0; j < NUM_STATE_DIRECTIONS; j++) {
+        d_sum[FIRST_STATE_DIRECTION + j][j] += 1.0;
+    }
+
+    // Tangent of normalize_state, evaluated at the unnormalized orientation.
+    const double q[4] = { sum.orientation.x, sum.orientation.y, sum.orientation.z, sum.orientation.w };
+    const double quaternion_norm_sq = q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3];
+    const double one_over_quaternion_norm = 1.0 / sqrt(quaternion_norm_sq);
+    double projections[TANGENT_BLOCK_WIDTH] = {};
+    for (int r = 0; r < 4; r++) {
+        for (int j = 0; j < TANGENT_BLOCK_WIDTH; j++) {
+            projections[j] += q[r] * d_sum[ORIENTATION_ROW + r][j];
+        }
+    }
+    for (int r = 0; r < 4; r++) {
+        for (int j = 0; j < TANGENT_BLOCK_WIDTH; j++) {
+            d_sum[ORIENTATION_ROW + r][j] = (d_sum[ORIENTATION_ROW + r][j] - q[r] * projections[j] / quaternion_norm_sq) * one_over_quaternion_norm;
+        }
+    }
+
+    for (int i = 0; i < DroneState::DIM; i++) {
+        for (int c = 0; c < FIRST_STATE_DIRECTION; c++) {
+            jacobians.d_state[i][c] = i == c ? 1.0 : 0.0;
+        }
+        for (int j = 0; j < NUM_STATE_DIRECTIONS; j++) {
+            jacobians.d_state[i][FIRST_STATE_DIRECTION + j] = d_sum[i][j];
+        }
+        for (int a = 0; a < DroneControlAction::DIM; a++) {
+            jacobians.d_action[i][a] = d_sum[i][NUM_STATE_DIRECTIONS + a];
+        }
+    }
+
+    normalize_state(sum);
+
+    next_state = sum;
+}
+
+void MultirotorPhysics::predict_batch(const DroneState* states, const DroneControlAction* actions, const size_t batch_size, const double dt, DroneState* next_states, DroneStateJacobians* jacobians) const {
+    this->predict_batch(nullptr, states, actions, batch_size, dt, next_states, jacobians);
 }
 
-DroneState MultirotorPhysics::physics_step(const DroneState& state, const DroneControlAction& action) const {
+void MultirotorPhysics::predict_batch(const DroneSpec* specs, const DroneState* states, const DroneControlAction* actions, const size_t batch_size, const double dt, DroneState* next_states, DroneStateJacobians* jacobians) const {
 
-    DroneState next_state = state; // TODO not sure if I need to copy here.
+    // Without specs, every element is stepped with the spec of this instance.
+    auto predict_range = [&](const size_t begin, const size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            const DroneSpec& spec = specs ? specs[i] : this->drone_spec;
+            if (jacobians) {
+                this->predict(spec, states[i], actions[i], dt, next_states[i], jacobians[i]);
+            } else {
+                this->predict(spec, states[i], actions[i], dt, next_states[i]);
+            }
+        }
+    };
+
+    const int32 num_tasks = static_cast<int32>((batch_size + BATCH_TASK_SIZE - 1) / BATCH_TASK_SIZE);
+    if (num_tasks <= 1) {
+        predict_range(0, batch_size);
+        return;
+    }
+    ParallelFor(num_tasks, [&](int32 task_idx) {
+        const size_t begin = task_idx * BATCH_TASK_SIZE;
+        predict_range(begin, std::min(begin + BATCH_TASK_SIZE, batch_size));
+    });
+}
+
+void MultirotorPhysics::rotor_wrench(const DroneSpec& spec, const DroneControlAction& action, RotorWrench& wrench, RotorWrench* d_wrenches) const {
 
 	// See rl_tools::rl::environments::multirotor::multirotor_dynamics
-    linalg::vec3 thrust = { .0f, .0f, .0f };
-    linalg::vec3 torque = { .0f, .0f, .0f };
+    wrench.thrust = { .0f, .0f, .0f };
+    wrench.torque = { .0f, .0f, .0f };
+    wrench.rpm_sum = 0.0;
 
-    for (size_t rotor_idx = 0; rotor_idx < this->drone_spec.num_rotors; rotor_idx++) {
+    for (size_t rotor_idx = 0; rotor_idx < spec.num_rotors; rotor_idx++) {
 
         double rpm = action.rmps_per_rotor[rotor_idx];
-        double thrust_magnitude = this->drone_spec.rpm_to_thrust_coefs.x + this->drone_spec.rpm_to_thrust_coefs.y * rpm + this->drone_spec.rpm_to_thrust_coefs.z * rpm * rpm;
+        double motor_scale = spec.motor_thrust_scales[rotor_idx];
+        double thrust_magnitude = motor_scale * (spec.rpm_to_thrust_coefs.x + spec.rpm_to_thrust_coefs.y * rpm + spec.rpm_to_thrust_coefs.z * rpm * rpm);
         linalg::vec3 thrust_vec;
-        linalg::scalar_multiply(this->drone_spec.rotor_thrust_directions[rotor_idx], thrust_magnitude, thrust_vec);
-        linalg::add_accumulate(thrust_vec, thrust);
+        linalg::scalar_multiply(spec.rotor_thrust_directions[rotor_idx], thrust_magnitude, thrust_vec);
+        linalg::add_accumulate(thrust_vec, wrench.thrust);
+
+        linalg::scalar_multiply_accumulate(spec.rotor_torque_directions[rotor_idx], thrust_magnitude * spec.rpm_to_torque_coef, wrench.torque);
+        linalg::cross_product_accumulate(spec.rotor_positions[rotor_idx], thrust_vec, wrench.torque);
+        wrench.rpm_sum += rpm;
 
-        linalg::scalar_multiply_accumulate(this->drone_spec.rotor_torque_directions[rotor_idx], thrust_magnitude * this->drone_spec.rpm_to_torque_coef, torque);
-        linalg::cross_product_accumulate(this->drone_spec.rotor_positions[rotor_idx], thrust_vec, torque);
+        if (d_wrenches) {
+            RotorWrench& d_wrench = d_wrenches[rotor_idx];
+            double d_thrust_magnitude = motor_scale * (spec.rpm_to_thrust_coefs.y + 2.0 * spec.rpm_to_thrust_coefs.z * rpm);
+            linalg::scalar_multiply(spec.rotor_thrust_directions[rotor_idx], d_thrust_magnitude, d_wrench.thrust);
+            linalg::scalar_multiply(spec.rotor_torque_directions[rotor_idx], d_thrust_magnitude * spec.rpm_to_torque_coef, d_wrench.torque);
+            linalg::cross_product_accumulate(spec.rotor_positions[rotor_idx], d_wrench.thrust, d_wrench.torque);
+            d_wrench.rpm_sum = 1.0;
+        }
     }
+}
+
+DroneState MultirotorPhysics::physics_step(const DroneSpec& spec, const DroneState& state, const RotorWrench& wrench,
+    const RotorWrench* d_wrenches, PhysicsStepJacobian* jacobian) const {
+
+    DroneState next_state;
 
-    next_state.position.x = current_state.linear_velocity.x;
-    next_state.position.y = current_state.linear_velocity.y;
-    next_state.position.z = current_state.linear_velocity.z;
+    next_state.position.x = state.linear_velocity.x;
+    next_state.position.y = state.linear_velocity.y;
+    next_state.position.z = state.linear_velocity.z;
 
-    linalg::quaternion_derivative(current_state.orientation, current_state.angular_velocity, next_state.orientation);
-    linalg::rotate_vector_by_quaternion(current_state.orientation, thrust, next_state.linear_velocity);
+    linalg::quaternion_derivative(state.orientation, state.angular_velocity, next_state.orientation);
+
+    // Body frame force and torque, including the optional aerodynamic effects.
+    const DroneAerodynamics& aerodynamics = spec.aerodynamics;
+    linalg::vec3 force = wrench.thrust;
+    linalg::vec3 torque = wrench.torque;
+    double ground_effect = 1.0;
+    double d_ground_effect = 0.0;
+    if (aerodynamics.enable_ground_effect) {
+        ground_effect = ground_effect_table.evaluate((state.position.z - aerodynamics.ground_height) * aerodynamics.one_over_rotor_radius, d_ground_effect);
+        linalg::scalar_multiply(force, ground_effect);
+        linalg::scalar_multiply(torque, ground_effect);
+    }
+    const bool has_drag = aerodynamics.enable_body_drag || aerodynamics.enable_rotor_drag;
+    linalg::mat3x3 rotation;
+    linalg::vec3 body_velocity;
+    if (has_drag) {
+        // Rotating into the body frame and back through one matrix is cheaper than two quaternion rotations.
+        linalg::rotation_matrix(state.orientation, rotation);
+        linalg::matrix_transpose_vector_product(rotation, state.linear_velocity, body_velocity);
+        if (aerodynamics.enable_body_drag) {
+            force.x -= (aerodynamics.linear_drag_coefs.x + aerodynamics.quadratic_drag_coefs.x * std::abs(body_velocity.x)) * body_velocity.x;
+            force.y -= (aerodynamics.linear_drag_coefs.y + aerodynamics.quadratic_drag_coefs.y * std::abs(body_velocity.y)) * body_velocity.y;
+            force.z -= (aerodynamics.linear_drag_coefs.z + aerodynamics.quadratic_drag_coefs.z * std::abs(body_velocity.z)) * body_velocity.z;
+        }
+        if (aerodynamics.enable_rotor_drag) {
+            const double rotor_drag = aerodynamics.rotor_drag_coef * wrench.rpm_sum;
+            force.x -= rotor_drag * body_velocity.x;
+            force.y -= rotor_drag * body_velocity.y;
+        }
+        linalg::matrix_vector_product(rotation, force, next_state.linear_velocity);
+    } else {
+        linalg::rotate_vector_by_quaternion(state.orientation, force, next_state.linear_velocity);
+    }
     
-    linalg::scalar_multiply(next_state.linear_velocity, 1.0 / this->drone_spec.drone_mass);
+    linalg::scalar_multiply(next_state.linear_velocity, 1.0 / spec.drone_mass);
     linalg::add_accumulate(this->gravity, next_state.linear_velocity);
 
     linalg::vec3 vector = { 0.0, 0.0, 0.0 };
     linalg::vec3 vector2 = { 0.0, 0.0, 0.0 };
-    linalg::matrix_vector_product(this->drone_spec.J, current_state.angular_velocity, vector);
-    linalg::cross_product(current_state.angular_velocity, vector, vector2);
+    linalg::matrix_vector_product(spec.J, state.angular_velocity, vector);
+    linalg::cross_product(state.angular_velocity, vector, vector2);
     linalg::sub(torque, vector2, vector);
-    linalg::matrix_vector_product(this->drone_spec.J_inv, vector, next_state.angular_velocity);
+    linalg::matrix_vector_product(spec.J_inv, vector, next_state.angular_velocity);
+
+    if (jacobian) {
+        const linalg::quat& q = state.orientation;
+        const linalg::vec3& w = state.angular_velocity;
+
+        // quaternion_derivative is bilinear in the orientation and the angular velocity.
+        const double orientation_d_orientation[4][4] = {
+            { 0.0, w.z, -w.y, w.x },
+            { -w.z, 0.0, w.x, w.y },
+            { w.y, -w.x, 0.0, w.z },
+            { -w.x, -w.y, -w.z, 0.0 }
+        };
+        const double orientation_d_angular_velocity[4][3] = {
+            { q.w, -q.z, q.y },
+            { q.z, q.w, -q.x },
+            { -q.y, q.x, q.w },
+            { -q.x, -q.y, -q.z }
+        };
+        for (int i = 0; i < 4; i++) {
+            for (int k = 0; k < 4; k++) {
+                jacobian->orientation_d_orientation[i][k] = 0.5 * orientation_d_orientation[i][k];
+            }
+            for (int k = 0; k < 3; k++) {
+                jacobian->orientation_d_angular_velocity[i][k] = 0.5 * orientation_d_angular_velocity[i][k];
+            }
+        }
+
+        // The world frame acceleration is rotation * force / mass, where the body frame force depends on the orientation
+        // and the linear velocity only through the drag and on the height only through the ground effect.
+        if (!has_drag) {
+            linalg::rotation_matrix(q, rotation);
+        }
+        const double R[3][3] = {
+            { rotation.v_0_0, rotation.v_0_1, rotation.v_0_2 },
+            { rotation.v_1_0, rotation.v_1_1, rotation.v_1_2 },
+            { rotation.v_2_0, rotation.v_2_1, rotation.v_2_2 }
+        };
+        const double one_over_mass = 1.0 / spec.drone_mass;
+        double force_d_action[3][DroneControlAction::DIM];
+        for (int a = 0; a < DroneControlAction::DIM; a++) {
+            force_d_action[0][a] = ground_effect * d_wrenches[a].thrust.x;
+            force_d_action[1][a] = ground_effect * d_wrenches[a].thrust.y;
+            force_d_action[2][a] = ground_effect * d_wrenches[a].thrust.z;
+        }
+        double rotation_d_orientation[3][4];
+        linalg::rotate_vector_by_quaternion_jacobian(q, force, rotation_d_orientation);
+        for (int i = 0; i < 3; i++) {
+            for (int k = 0; k < 4; k++) {
+                jacobian->linear_velocity_d_orientation[i][k] = rotation_d_orientation[i][k] * one_over_mass;
+            }
+        }
+
+        jacobian->depends_on_linear_velocity = has_drag;
+        if (has_drag) {
+            // The drag along each body axis only depends on the body velocity along that axis.
+            double drag_gains[3] = { 0.0, 0.0, 0.0 };
+            if (aerodynamics.enable_body_drag) {
+                drag_gains[0] = aerodynamics.linear_drag_coefs.x + 2.0 * aerodynamics.quadratic_drag_coefs.x * std::abs(body_velocity.x);
+                drag_gains[1] = aerodynamics.linear_drag_coefs.y + 2.0 * aerodynamics.quadratic_drag_coefs.y * std::abs(body_velocity.y);
+                drag_gains[2] = aerodynamics.linear_drag_coefs.z + 2.0 * aerodynamics.quadratic_drag_coefs.z * std::abs(body_velocity.z);
+            }
+            if (aerodynamics.enable_rotor_drag) {
+                const double rotor_drag = aerodynamics.rotor_drag_coef * wrench.rpm_sum;
+                drag_gains[0] += rotor_drag;
+                drag_gains[1] += rotor_drag;
+                for (int a = 0; a < DroneControlAction::DIM; a++) {
+                    const double d_rotor_drag = aerodynamics.rotor_drag_coef * d_wrenches[a].rpm_sum;
+                    force_d_action[0][a] -= d_rotor_drag * body_velocity.x;
+                    force_d_action[1][a] -= d_rotor_drag * body_velocity.y;
+                }
+            }
+
+            // body_velocity rotates the linear velocity by the conjugate orientation, whose vector part has the opposite sign.
+            linalg::quat orientation_inv;
+            double body_velocity_d_orientation[3][4];
+            double force_d_orientation[3][4];
+            double force_d_linear_velocity[3][3];
+            linalg::conjugate(q, orientation_inv);
+            linalg::rotate_vector_by_quaternion_jacobian(orientation_inv, state.linear_velocity, body_velocity_d_orientation);
+            for (int i = 0; i < 3; i++) {
+                for (int k = 0; k < 4; k++) {
+                    force_d_orientation[i][k] = (k < 3 ? drag_gains[i] : -drag_gains[i]) * body_velocity_d_orientation[i][k];
+                }
+                for (int l = 0; l < 3; l++) {
+                    force_d_linear_velocity[i][l] = -drag_gains[i] * R[l][i];
+                }
+            }
+            for (int i = 0; i < 3; i++) {
+                for (int k = 0; k < 4; k++) {
+                    double d_orientation_sum = 0.0;
+                    for (int m = 0; m < 3; m++) {
+                        d_orientation_sum += R[i][m] * force_d_orientation[m][k];
+                    }
+                    jacobian->linear_velocity_d_orientation[i][k] += d_orientation_sum * one_over_mass;
+                }
+                for (int l = 0; l < 3; l++) {
+                    double d_linear_velocity_sum = 0.0;
+                    for (int m = 0; m < 3; m++) {
+                        d_linear_velocity_sum += R[i][m] * force_d_linear_velocity[m][l];
+                    }
+                    jacobian->linear_velocity_d_linear_velocity[i][l] = d_linear_velocity_sum * one_over_mass;
+                }
+            }
+        }
+
+        for (int i = 0; i < 3; i++) {
+            for (int a = 0; a < DroneControlAction::DIM; a++) {
+                double d_action_sum = 0.0;
+                for (int m = 0; m < 3; m++) {
+                    d_action_sum += R[i][m] * force_d_action[m][a];
+                }
+                jacobian->linear_velocity_d_action[i][a] = d_action_sum * one_over_mass;
+            }
+        }
+
+        // angular acceleration = J_inv * (torque - w x J w), where the derivative of w x J w is [w]x J - [J w]x.
+        const linalg::mat3x3& J = spec.J;
+        const linalg::mat3x3& J_inv = spec.J_inv;
+        linalg::vec3 Jw;
+        linalg::matrix_vector_product(J, w, Jw);
+        const double gyroscopic_d_angular_velocity[3][3] = {
+            { w.y * J.v_2_0 - w.z * J.v_1_0, w.y * J.v_2_1 - w.z * J.v_1_1 + Jw.z, w.y * J.v_2_2 - w.z * J.v_1_2 - Jw.y },
+            { w.z * J.v_0_0 - w.x * J.v_2_0 - Jw.z, w.z * J.v_0_1 - w.x * J.v_2_1, w.z * J.v_0_2 - w.x * J.v_2_2 + Jw.x },
+            { w.x * J.v_1_0 - w.y * J.v_0_0 + Jw.y, w.x * J.v_1_1 - w.y * J.v_0_1 - Jw.x, w.x * J.v_1_2 - w.y * J.v_0_2 }
+        };
+        const double J_inv_rows[3][3] = {
+            { J_inv.v_0_0, J_inv.v_0_1, J_inv.v_0_2 },
+            { J_inv.v_1_0, J_inv.v_1_1, J_inv.v_1_2 },
+            { J_inv.v_2_0, J_inv.v_2_1, J_inv.v_2_2 }
+        };
+        for (int i = 0; i < 3; i++) {
+            for (int l = 0; l < 3; l++) {
+                double d_angular_velocity_sum = 0.0;
+                for (int m = 0; m < 3; m++) {
+                    d_angular_velocity_sum -= J_inv_rows[i][m] * gyroscopic_d_angular_velocity[m][l];
+                }
+                jacobian->angular_velocity_d_angular_velocity[i][l] = d_angular_velocity_sum;
+            }
+            for (int a = 0; a < DroneControlAction::DIM; a++) {
+                jacobian->angular_velocity_d_action[i][a] = ground_effect * (J_inv_rows[i][0] * d_wrenches[a].torque.x
+                    + J_inv_rows[i][1] * d_wrenches[a].torque.y + J_inv_rows[i][2] * d_wrenches[a].torque.z);
+            }
+        }
+
+        // The ground effect scales both thrust and torque.
+        jacobian->depends_on_height = aerodynamics.enable_ground_effect;
+        if (aerodynamics.enable_ground_effect) {
+            const double d_height = d_ground_effect * aerodynamics.one_over_rotor_radius;
+            for (int i = 0; i < 3; i++) {
+                jacobian->linear_velocity_d_height[i] = (R[i][0] * wrench.thrust.x + R[i][1] * wrench.thrust.y + R[i][2] * wrench.thrust.z) * d_height * one_over_mass;
+                jacobian->angular_velocity_d_height[i] = (J_inv_rows[i][0] * wrench.torque.x + J_inv_rows[i][1] * wrench.torque.y + J_inv_rows[i][2] * wrench.torque.z) * d_height;
+            }
+        }
+    }
 
     return next_state;
 }
+
+void MultirotorPhysics::physics_step_tangent(const PhysicsStepJacobian& jacobian, const TangentBlock& d_state, TangentBlock& d_out) {
+
+    // Every row of d_out is one expression over the rows of d_state it depends on, evaluated for all directions at once.
+    // The rows are computed into a local array first, which tells the compiler that they don't alias d_state.
+    static constexpr int W = TANGENT_BLOCK_WIDTH;
+    const double* d_height = d_state[FIRST_STATE_DIRECTION];
+    const double* d_qx = d_state[ORIENTATION_ROW];
+    const double* d_qy = d_state[ORIENTATION_ROW + 1];
+    const double* d_qz = d_state[ORIENTATION_ROW + 2];
+    const double* d_qw = d_state[ORIENTATION_ROW + 3];
+    const double* d_vx = d_state[LINEAR_VELOCITY_ROW];
+    const double* d_vy = d_state[LINEAR_VELOCITY_ROW + 1];
+    const double* d_vz = d_state[LINEAR_VELOCITY_ROW + 2];
+    const double* d_wx = d_state[ANGULAR_VELOCITY_ROW];
+    const double* d_wy = d_state[ANGULAR_VELOCITY_ROW + 1];
+    const double* d_wz = d_state[ANGULAR_VELOCITY_ROW + 2];
+    double row[W];
+
+    for (int i = 0; i < 3; i++) {
+        std::copy(d_state[LINEAR_VELOCITY_ROW + i], d_state[LINEAR_VELOCITY_ROW + i] + W, d_out[i]);
+    }
+
+    for (int i = 0; i < 4; i++) {
+        const double* q = jacobian.orientation_d_orientation[i];
+        const double* w = jacobian.orientation_d_angular_velocity[i];
+        for (int j = 0; j < W; j++) {
+            row[j] = q[0] * d_qx[j] + q[1] * d_qy[j] + q[2] * d_qz[j] + q[3] * d_qw[j]
+                + w[0] * d_wx[j] + w[1] * d_wy[j] + w[2] * d_wz[j];
+        }
+        std::copy(row, row + W, d_out[ORIENTATION_ROW + i]);
+    }
+
+    for (int i = 0; i < 3; i++) {
+        const double* q = jacobian.linear_velocity_d_orientation[i];
+        for (int j = 0; j < W; j++) {
+            row[j] = q[0] * d_qx[j] + q[1] * d_qy[j] + q[2] * d_qz[j] + q[3] * d_qw[j];
+        }
+        if (jacobian.depends_on_linear_velocity) {
+            const double* v = jacobian.linear_velocity_d_linear_velocity[i];
+            for (int j = 0; j < W; j++) {
+                row[j] += v[0] * d_vx[j] + v[1] * d_vy[j] + v[2] * d_vz[j];
+            }
+        }
+        if (jacobian.depends_on_height) {
+            const double h = jacobian.linear_velocity_d_height[i];
+            for (int j = 0; j < W; j++) {
+                row[j] += h * d_height[j];
+            }
+        }
+        for (int a = 0; a < DroneControlAction::DIM; a++) {
+            row[NUM_STATE_DIRECTIONS + a] += jacobian.linear_velocity_d_action[i][a];
+        }
+        std::copy(row, row + W, d_out[LINEAR_VELOCITY_ROW + i]);
+    }
+
+    for (int i = 0; i < 3; i++) {
+        const double* w = jacobian.angular_velocity_d_angular_velocity[i];
+        for (int j = 0; j < W; j++) {
+            row[j] = w[0] * d_wx[j] + w[1] * d_wy[j] + w[2] * d_wz[j];
+        }
+        if (jacobian.depends_on_height) {
+            const double h = jacobian.angular_velocity_d_height[i];
+            for (int j = 0; j < W; j++) {
+                row[j] += h * d_height[j];
+            }
+        }
+        for (int a = 0; a < DroneControlAction::DIM; a++) {
+            row[NUM_STATE_DIRECTIONS + a] += jacobian.angular_velocity_d_action[i][a];
+        }
+        std::copy(row, row + W, d_out[ANGULAR_VELOCITY_ROW + i]);
+    }
+}
+
+void MultirotorPhysics::physics_step_tangent(const PhysicsStepJacobian& jacobian, TangentBlock& d_out) {
+
+    // Columns of the state directions, relative to the first one.
+    static constexpr int HEIGHT_COLUMN = 0;
+    static constexpr int ORIENTATION_COLUMN = ORIENTATION_ROW - FIRST_STATE_DIRECTION;
+    static constexpr int LINEAR_VELOCITY_COLUMN = LINEAR_VELOCITY_ROW - FIRST_STATE_DIRECTION;
+    static constexpr int ANGULAR_VELOCITY_COLUMN = ANGULAR_VELOCITY_ROW - FIRST_STATE_DIRECTION;
+
+    std::fill(&d_out[0][0], &d_out[0][0] + DroneState::DIM * TANGENT_BLOCK_WIDTH, 0.0);
+    for (int i = 0; i < 3; i++) {
+        d_out[i][LINEAR_VELOCITY_COLUMN + i] = 1.0;
+    }
+    for (int i = 0; i < 4; i++) {
+        double* out = d_out[ORIENTATION_ROW + i];
+        for (int l = 0; l < 4; l++) {
+            out[ORIENTATION_COLUMN + l] = jacobian.orientation_d_orientation[i][l];
+        }
+        for (int l = 0; l < 3; l++) {
+            out[ANGULAR_VELOCITY_COLUMN + l] = jacobian.orientation_d_angular_velocity[i][l];
+        }
+    }
+    for (int i = 0; i < 3; i++) {
+        double* out = d_out[LINEAR_VELOCITY_ROW + i];
+        if (jacobian.depends_on_height) {
+            out[HEIGHT_COLUMN] = jacobian.linear_velocity_d_height[i];
+        }
+        for (int l = 0; l < 4; l++) {
+            out[ORIENTATION_COLUMN + l] = jacobian.linear_velocity_d_orientation[i][l];
+        }
+        if (jacobian.depends_on_linear_velocity) {
+            for (int l = 0; l < 3; l++) {
+                out[LINEAR_VELOCITY_COLUMN + l] = jacobian.linear_velocity_d_linear_velocity[i][l];
+            }
+        }
+        for (int a = 0; a < DroneControlAction::DIM; a++) {
+            out[NUM_STATE_DIRECTIONS + a] = jacobian.linear_velocity_d_action[i][a];
+        }
+    }
+    for (int i = 0; i < 3; i++) {
+        double* out = d_out[ANGULAR_VELOCITY_ROW + i];
+        if (jacobian.depends_on_height) {
+            out[HEIGHT_COLUMN] = jacobian.angular_velocity_d_height[i];
+        }
+        for (int l = 0; l < 3; l++) {
+            out[ANGULAR_VELOCITY_COLUMN + l] = jacobian.angular_velocity_d_angular_velocity[i][l];
+        }
+        for (int a = 0; a < DroneControlAction::DIM; a++) {
+            out[NUM_STATE_DIRECTIONS + a] = jacobian.angular_velocity_d_action[i][a];
+        }
+    }
+}
@@ -24,19 +24,66 @@ struct DroneControlAction {
 	double rmps_per_rotor[DroneControlAction::DIM];
 };
 
+/**
+ * Jacobians of the state after one apply_control step with respect to the state and the action before the step.
+ * Rows and columns follow the flat DroneState layout (position, orientation, linear_velocity, angular_velocity),
+ * which is also the order in which UMLAdapterSensor_DroneState serializes the state.
+ * The action columns are derivatives with respect to the rpm of each rotor.
+ */
+struct DroneStateJacobians {
+    double d_state[DroneState::DIM][DroneState::DIM];
+    double d_action[DroneState::DIM][DroneControlAction::DIM];
+};
+
+/**
+ * Optional aerodynamic effects on top of the rotor thrust. All of them are disabled by default.
+ */
+struct DroneAerodynamics {
+	// Body frame drag force -linear_drag_coefs * v_body - quadratic_drag_coefs * v_body * |v_body| (component-wise).
+	bool enable_body_drag = false;
+	linalg::vec3 linear_drag_coefs = { 0.0, 0.0, 0.0 };
+	linalg::vec3 quadratic_drag_coefs = { 0.0, 0.0, 0.0 };
+
+	// Blade flapping and induced drag of the spinning rotors, proportional to the rotor speed and the
+	// velocity in the rotor plane: -rotor_drag_coef * sum(rpm) * (v_body.x, v_body.y, 0).
+	bool enable_rotor_drag = false;
+	double rotor_drag_coef = 0.0;
+
+	// Increase of thrust and rotor torque close to the floor (Cheeseman-Bennett), evaluated from a lookup table
+	// over the height above ground_height in rotor radii. ground_height and rotor_radius are in the same units
+	// as DroneState::position, the default radius is the one of a Crazyflie in meters, see set_rotor_radius.
+	bool enable_ground_effect = false;
+	double ground_height = 0.0;
+	double rotor_radius = 0.0231;
+	// Must be kept consistent with rotor_radius.
+	double one_over_rotor_radius = 1.0 / 0.0231;
+
+	void set_rotor_radius(const double radius) {
+		rotor_radius = radius;
+		one_over_rotor_radius = 1.0 / radius;
+	}
+};
+
+/**
+ * Physical parameters of a drone. Plain values without indirections, so that specs can be
+ * stored per environment in contiguous arrays next to the states they are stepped with.
+ */
 struct DroneSpec {
-	// TODO this stuff should be more flexible
-	const size_t num_rotors = 4;
+	size_t num_rotors = 4;
 
-	const linalg::vec3 rpm_to_thrust_coefs = { 0.0, 0.0, 3.16e-10 };
-	const double rpm_to_torque_coef = 0.005964552;
-	const double drone_mass = 0.027;
+	linalg::vec3 rpm_to_thrust_coefs = { 0.0, 0.0, 3.16e-10 };
+	double rpm_to_torque_coef = 0.005964552;
+	double drone_mass = 0.027;
 
-	const linalg::vec3 rotor_thrust_directions[4] = { { 0.0, 0.0, 1.0 }, { 0.0, 0.0, 1.0 }, { 0.0, 0.0, 1.0 }, { 0.0, 0.0, 1.0 } };
-	const linalg::vec3 rotor_torque_directions[4] = { { 0.0, 0.0, -1.0 }, { 0.0, 0.0, +1.0 }, { 0.0, 0.0, -1.0 }, { 0.0, 0.0, +1.0 } };
-	const linalg::vec3 rotor_positions[4] = { { 0.028, -0.028, 0 }, { -0.028, -0.028, 0 }, { -0.028, 0.028, 0 }, { 0.028, 0.028, 0 } };
+	linalg::vec3 rotor_thrust_directions[4] = { { 0.0, 0.0, 1.0 }, { 0.0, 0.0, 1.0 }, { 0.0, 0.0, 1.0 }, { 0.0, 0.0, 1.0 } };
+	linalg::vec3 rotor_torque_directions[4] = { { 0.0, 0.0, -1.0 }, { 0.0, 0.0, +1.0 }, { 0.0, 0.0, -1.0 }, { 0.0, 0.0, +1.0 } };
+	linalg::vec3 rotor_positions[4] = { { 0.028, -0.028, 0 }, { -0.028, -0.028, 0 }, { -0.028, 0.028, 0 }, { 0.028, 0.028, 0 } };
+	// Per motor factor on the thrust (and thus the torque) to model asymmetric motors.
+	double motor_thrust_scales[4] = { 1.0, 1.0, 1.0, 1.0 };
 
-    const linalg::mat3x3 J = {
+	DroneAerodynamics aerodynamics;
+
+    linalg::mat3x3 J = {
         3.85e-6,
         0.0,
         0.0,
@@ -49,7 +96,8 @@ struct DroneSpec {
         0.0,
         5.9675e-6
     };
-    const linalg::mat3x3 J_inv = {
+    // Must be kept consistent with J, see randomize_drone_spec.
+    linalg::mat3x3 J_inv = {
         259740.2597402597,
         0.0,
         0.0,
@@ -85,6 +133,33 @@ public:
 	// TODO maybe I should use a fixed simulation update rate and make sure that the simulation runs for as many steps as needed to match ue5's tick rate.
 	void apply_control(const DroneControlAction& action, const double dt);
 
+	/**
+	* Same as apply_control, but additionally writes the Jacobians of the resulting state with respect to
+	* the previous state and the action. The Jacobians are propagated analytically through the rk4 stages:
+	* the partial derivatives of the dynamics are evaluated once per stage and applied to all directions together.
+	*/
+	void apply_control(const DroneControlAction& action, const double dt, DroneStateJacobians& jacobians);
+
+	/**
+	* Advance an arbitrary state by dt without touching the state of this instance.
+	*/
+	void predict(const DroneState& state, const DroneControlAction& action, const double dt, DroneState& next_state) const;
+
+	void predict(const DroneState& state, const DroneControlAction& action, const double dt, DroneState& next_state, DroneStateJacobians& jacobians) const;
+
+	/**
+	* Batched version of predict. jacobians may be nullptr if only the next states are needed.
+	* next_states may alias states to step a batch in place. Large batches are split into parallel tasks,
+	* batches of up to BATCH_TASK_SIZE elements are stepped on the calling thread.
+	*/
+	void predict_batch(const DroneState* states, const DroneControlAction* actions, const size_t batch_size, const double dt, DroneState* next_states, DroneStateJacobians* jacobians) const;
+
+	/**
+	* Batched version of predict where every element is stepped with its own spec, e.g. for domain randomization.
+	* specs is a contiguous array with one entry per state.
+	*/
+	void predict_batch(const DroneSpec* specs, const DroneState* states, const DroneControlAction* actions, const size_t batch_size, const double dt, DroneState* next_states, DroneStateJacobians* jacobians) const;
+
     const linalg::vec3& get_position() const {
         return this->current_state.position;
     }
@@ -109,9 +184,88 @@ public:
         return this->prev_action;
     }
 
+    void set_drone_spec(const DroneSpec& spec) {
+        this->drone_spec = spec;
+    }
+
+    const DroneSpec& get_drone_spec() const {
+        return this->drone_spec;
+    }
+
+    static constexpr size_t BATCH_TASK_SIZE = 256;
+
 private:
 
-	DroneState physics_step(const DroneState& current_state, const DroneControlAction& action) const;
+	void predict(const DroneSpec& spec, const DroneState& state, const DroneControlAction& action, const double dt, DroneState& next_state) const;
+
+	void predict(const DroneSpec& spec, const DroneState& state, const DroneControlAction& action, const double dt, DroneState& next_state, DroneStateJacobians& jacobians) const;
+
+	/**
+	* Everything that only depends on the action, summed over all rotors in the body frame.
+	*/
+	struct RotorWrench {
+		linalg::vec3 thrust;
+		linalg::vec3 torque;
+		double rpm_sum;
+	};
+
+	/**
+	* The action is constant over an rk4 step, so this only needs to be evaluated once per step.
+	* If d_wrenches is given, it receives the derivatives of the wrench with respect to the rpm of each rotor.
+	*/
+	void rotor_wrench(const DroneSpec& spec, const DroneControlAction& action, RotorWrench& wrench, RotorWrench* d_wrenches = nullptr) const;
+
+	/**
+	* Partial derivatives of physics_step with respect to its inputs. The position only enters the dynamics through the
+	* height in the ground effect and the action only through the rotor wrench, so only the blocks that are neither
+	* zero nor the identity are stored. Rows and columns follow the component order of the DroneState members.
+	*/
+	struct PhysicsStepJacobian {
+		// The blocks with respect to the height and the linear velocity are only set if the ground effect
+		// or the drag are enabled, otherwise they are zero.
+		bool depends_on_height;
+		bool depends_on_linear_velocity;
+		double orientation_d_orientation[4][4];
+		double orientation_d_angular_velocity[4][3];
+		double linear_velocity_d_height[3];
+		double linear_velocity_d_orientation[3][4];
+		double linear_velocity_d_linear_velocity[3][3];
+		double linear_velocity_d_action[3][DroneControlAction::DIM];
+		double angular_velocity_d_height[3];
+		double angular_velocity_d_angular_velocity[3][3];
+		double angular_velocity_d_action[3][DroneControlAction::DIM];
+	};
+
+	/**
+	* If jacobian is given, it receives the partial derivatives at current_state, which requires the d_wrenches of rotor_wrench.
+	*/
+	DroneState physics_step(const DroneSpec& spec, const DroneState& current_state, const RotorWrench& wrench,
+		const RotorWrench* d_wrenches = nullptr, PhysicsStepJacobian* jacobian = nullptr) const;
+
+	// Tangent directions that are propagated through the rk4 stages: position.z, orientation, linear_velocity,
+	// angular_velocity and the rotor rpms. position.x and position.y don't influence the dynamics.
+	static constexpr int FIRST_STATE_DIRECTION = 2;
+	static constexpr int NUM_STATE_DIRECTIONS = DroneState::DIM - FIRST_STATE_DIRECTION;
+	static constexpr int NUM_DIRECTIONS = NUM_STATE_DIRECTIONS + DroneControlAction::DIM;
+
+	/**
+	* Tangents of all directions, one row per state component and one column per direction, so that the
+	* inner loops run over the directions with the same coefficients. The rows are padded to an even width,
+	* so that these loops vectorize without a remainder, the padding columns stay zero.
+	*/
+	static constexpr int TANGENT_BLOCK_WIDTH = (NUM_DIRECTIONS + 1) / 2 * 2;
+	typedef double TangentBlock[DroneState::DIM][TANGENT_BLOCK_WIDTH];
+
+	/**
+	* Applies the partial derivatives of physics_step to the tangents d_state of all directions.
+	*/
+	static void physics_step_tangent(const PhysicsStepJacobian& jacobian, const TangentBlock& d_state, TangentBlock& d_out);
+
+	/**
+	* Same as physics_step_tangent for the tangents of the initial state, i.e. the unit vectors, which only
+	* needs to arrange the partial derivatives in the columns of their directions.
+	*/
+	static void physics_step_tangent(const PhysicsStepJacobian& jacobian, TangentBlock& d_out);
 
     static inline void state_add_accumulate(const DroneState& s, DroneState& out) {
         linalg::add_accumulate(s.position, out.position);
@@ -158,6 +312,6 @@ private:
     DroneState current_state;
 
 
-	const DroneSpec drone_spec;
+	DroneSpec drone_spec;
     const linalg::vec3 gravity = { 0.0, 0.0, -9.81 };
 };
\ No newline at end of file
@@ -17,6 +17,13 @@ namespace linalg {
         double x, y, z, w;
     };
 
+    static inline void conjugate(const quat& q, quat& out) {
+        out.x = -q.x;
+        out.y = -q.y;
+        out.z = -q.z;
+        out.w = q.w;
+    }
+
     static inline void scalar_multiply(const vec3& v, const double s, vec3& out) {
         out.x = v.x * s;
         out.y = v.y * s;
@@ -123,6 +130,28 @@ namespace linalg {
         out.z = A.v_2_0 * v.x + A.v_2_1 * v.y + A.v_2_2 * v.z;
     }
 
+    static inline void matrix_transpose_vector_product(const mat3x3& A, const vec3& v, vec3& out) {
+        out.x = A.v_0_0 * v.x + A.v_1_0 * v.y + A.v_2_0 * v.z;
+        out.y = A.v_0_1 * v.x + A.v_1_1 * v.y + A.v_2_1 * v.z;
+        out.z = A.v_0_2 * v.x + A.v_1_2 * v.y + A.v_2_2 * v.z;
+    }
+
+    static inline void inverse(const mat3x3& A, mat3x3& out) {
+        const double c_0_0 = A.v_1_1 * A.v_2_2 - A.v_1_2 * A.v_2_1;
+        const double c_0_1 = A.v_1_2 * A.v_2_0 - A.v_1_0 * A.v_2_2;
+        const double c_0_2 = A.v_1_0 * A.v_2_1 - A.v_1_1 * A.v_2_0;
+        const double one_over_det = 1.0 / (A.v_0_0 * c_0_0 + A.v_0_1 * c_0_1 + A.v_0_2 * c_0_2);
+        out.v_0_0 = c_0_0 * one_over_det;
+        out.v_0_1 = (A.v_0_2 * A.v_2_1 - A.v_0_1 * A.v_2_2) * one_over_det;
+        out.v_0_2 = (A.v_0_1 * A.v_1_2 - A.v_0_2 * A.v_1_1) * one_over_det;
+        out.v_1_0 = c_0_1 * one_over_det;
+        out.v_1_1 = (A.v_0_0 * A.v_2_2 - A.v_0_2 * A.v_2_0) * one_over_det;
+        out.v_1_2 = (A.v_0_2 * A.v_1_0 - A.v_0_0 * A.v_1_2) * one_over_det;
+        out.v_2_0 = c_0_2 * one_over_det;
+        out.v_2_1 = (A.v_0_1 * A.v_2_0 - A.v_0_0 * A.v_2_1) * one_over_det;
+        out.v_2_2 = (A.v_0_0 * A.v_1_1 - A.v_0_1 * A.v_1_0) * one_over_det;
+    }
+
     static inline void quaternion_derivative(const quat& q, const vec3& omega, quat& q_dot) {
         q_dot.x = q.w * omega.x + q.y * omega.z - q.z * omega.y;
         q_dot.y = q.w * omega.y + q.z * omega.x - q.x * omega.z;
@@ -139,4 +168,50 @@ namespace linalg {
         scalar_multiply_accumulate(var, q.w, v_out);
         add_accumulate(v, v_out);
     }
+
+    /**
+     * Matrix of the linear map v -> rotate_vector_by_quaternion(q, v). Its transpose applies the conjugate rotation,
+     * so both directions can share it when a vector has to be rotated into the body frame and back.
+     */
+    static inline void rotation_matrix(const quat& q, mat3x3& out) {
+        const double xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+        const double xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+        const double wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+        out.v_0_0 = 1.0 - 2.0 * (yy + zz);
+        out.v_0_1 = 2.0 * (xy - wz);
+        out.v_0_2 = 2.0 * (xz + wy);
+        out.v_1_0 = 2.0 * (xy + wz);
+        out.v_1_1 = 1.0 - 2.0 * (xx + zz);
+        out.v_1_2 = 2.0 * (yz - wx);
+        out.v_2_0 = 2.0 * (xz - wy);
+        out.v_2_1 = 2.0 * (yz + wx);
+        out.v_2_2 = 1.0 - 2.0 * (xx + yy);
+    }
+
+    /**
+     * Jacobian of rotate_vector_by_quaternion(q, v) with respect to (q.x, q.y, q.z, q.w), v held fixed.
+     * The derivative with respect to v is rotation_matrix(q), since the rotation is linear in v.
+     * Expands v + 2 * q.w * (u x v) + 2 * u x (u x v) = v * (1 - 2 |u|^2) + 2 * u * (u . v) + 2 * q.w * (u x v) with u = (q.x, q.y, q.z).
+     */
+    static inline void rotate_vector_by_quaternion_jacobian(const quat& q, const vec3& v, double (&out)[3][4]) {
+        const double u_dot_v = q.x * v.x + q.y * v.y + q.z * v.z;
+        const double u[3] = { q.x, q.y, q.z };
+        const double v_array[3] = { v.x, v.y, v.z };
+        for (int k = 0; k < 3; k++) {
+            for (int i = 0; i < 3; i++) {
+                out[i][k] = -4.0 * u[k] * v_array[i] + 2.0 * u[i] * v_array[k];
+            }
+            out[k][k] += 2.0 * u_dot_v;
+        }
+        // 2 * q.w * (e_k x v)
+        out[1][0] -= 2.0 * q.w * v.z;
+        out[2][0] += 2.0 * q.w * v.y;
+        out[0][1] += 2.0 * q.w * v.z;
+        out[2][1] -= 2.0 * q.w * v.x;
+        out[0][2] -= 2.0 * q.w * v.y;
+        out[1][2] += 2.0 * q.w * v.x;
+        out[0][3] = 2.0 * (q.y * v.z - q.z * v.y);
+        out[1][3] = 2.0 * (q.z * v.x - q.x * v.z);
+        out[2][3] = 2.0 * (q.x * v.y - q.y * v.x);
+    }
 }